@@ -55,7 +55,10 @@ HEADERS += \
 	Sources/Dialogs/ProcessOutputWindow.hpp \
 	Sources/Dialogs/SetupDialog.hpp \
 	Sources/Dialogs/WADDescViewer.hpp \
+	Sources/Utils/BinaryCacheFile.hpp \
 	Sources/Utils/ContainerUtils.hpp \
+	Sources/Utils/DirScanner.hpp \
+	Sources/Utils/DirWatcher.hpp \
 	Sources/Utils/DoomModBundles.hpp \
 	Sources/Utils/EnumTraits.hpp \
 	Sources/Utils/ErrorHandling.hpp \
@@ -64,11 +67,15 @@ HEADERS += \
 	Sources/Utils/ExeReaderTypes.hpp \
 	Sources/Utils/FileInfoCache.hpp \
 	Sources/Utils/FileInfoCacheTypes.hpp \
+	Sources/Utils/FileStatCache.hpp \
 	Sources/Utils/FileSystemUtils.hpp \
 	Sources/Utils/FileSystemUtilsTypes.hpp \
+	Sources/Utils/HashUtils.hpp \
 	Sources/Utils/JsonUtils.hpp \
 	Sources/Utils/LangUtils.hpp \
 	Sources/Utils/MapInfo.hpp \
+	Sources/Utils/MapInfoTokenizer.hpp \
+	Sources/Utils/MappedFile.hpp \
 	Sources/Utils/MiscUtils.hpp \
 	Sources/Utils/OSUtils.hpp \
 	Sources/Utils/OSUtilsTypes.hpp \
@@ -77,13 +84,17 @@ HEADERS += \
 	Sources/Utils/PtrList.hpp \
 	Sources/Utils/StandardOutput.hpp \
 	Sources/Utils/StringUtils.hpp \
+	Sources/Utils/ThreadUtils.hpp \
 	Sources/Utils/TimeStats.hpp \
 	Sources/Utils/TypeTraits.hpp \
 	Sources/Utils/UniqueIdGenerator.hpp \
 	Sources/Utils/Version.hpp \
+	Sources/Utils/WADFormat.hpp \
+	Sources/Utils/WADLumpIndex.hpp \
 	Sources/Utils/WADReader.hpp \
 	Sources/Utils/WidgetUtils.hpp \
 	Sources/Utils/WindowsUtils.hpp \
+	Sources/Utils/ZipEntryIndex.hpp \
 	Sources/Utils/ZipReader.hpp \
 	Sources/Widgets/ExtendedListView.hpp \
 	Sources/Widgets/ExtendedTreeView.hpp \
@@ -120,7 +131,10 @@ SOURCES += \
 	Sources/Dialogs/ProcessOutputWindow.cpp \
 	Sources/Dialogs/SetupDialog.cpp \
 	Sources/Dialogs/WADDescViewer.cpp \
+	Sources/Utils/BinaryCacheFile.cpp \
 	Sources/Utils/ContainerUtils.cpp \
+	Sources/Utils/DirScanner.cpp \
+	Sources/Utils/DirWatcher.cpp \
 	Sources/Utils/DoomModBundles.cpp \
 	Sources/Utils/ErrorHandling.cpp \
 	Sources/Utils/EventFilters.cpp \
@@ -128,11 +142,14 @@ SOURCES += \
 	Sources/Utils/ExeReaderTypes.cpp \
 	Sources/Utils/FileInfoCache.cpp \
 	Sources/Utils/FileInfoCacheTypes.cpp \
+	Sources/Utils/FileStatCache.cpp \
 	Sources/Utils/FileSystemUtils.cpp \
 	Sources/Utils/FileSystemUtilsTypes.cpp \
 	Sources/Utils/LangUtils.cpp \
 	Sources/Utils/JsonUtils.cpp \
 	Sources/Utils/MapInfo.cpp \
+	Sources/Utils/MapInfoTokenizer.cpp \
+	Sources/Utils/MappedFile.cpp \
 	Sources/Utils/MiscUtils.cpp \
 	Sources/Utils/OSUtils.cpp \
 	Sources/Utils/OSUtilsTypes.cpp \
@@ -141,12 +158,16 @@ SOURCES += \
 	Sources/Utils/PtrList.cpp \
 	Sources/Utils/StandardOutput.cpp \
 	Sources/Utils/StringUtils.cpp \
+	Sources/Utils/ThreadUtils.cpp \
 	Sources/Utils/TypeTraitsTest.cpp \
 	Sources/Utils/UniqueIdGenerator.cpp \
 	Sources/Utils/Version.cpp \
+	Sources/Utils/WADFormat.cpp \
+	Sources/Utils/WADLumpIndex.cpp \
 	Sources/Utils/WADReader.cpp \
 	Sources/Utils/WidgetUtils.cpp \
 	Sources/Utils/WindowsUtils.cpp \
+	Sources/Utils/ZipEntryIndex.cpp \
 	Sources/Utils/ZipReader.cpp \
 	Sources/Widgets/ExtendedListView.cpp \
 	Sources/Widgets/ExtendedTreeView.cpp \
@@ -97,10 +97,9 @@ void showTxtDescriptionFor( QWidget * parentWindow, const QString & filePath, co
 
 	if (dataFileInfo.suffix() == "zip")
 	{
-		// try a txt file within the zip file
+		// try a txt file within the zip file, the names inside the zip are compared case-insensitively
 		QString descFileName_txt = fs::getFileNameFromPath( fs::replaceFileSuffix( filePath, "txt" ) );
-		QString descFileName_TXT = fs::getFileNameFromPath( fs::replaceFileSuffix( filePath, "TXT" ) );
-		auto content = readOneOfFilesInsideZip( dataFileInfo.filePath(), { descFileName_txt, descFileName_TXT } );
+		auto content = readOneOfFilesInsideZip( dataFileInfo.filePath(), { descFileName_txt } );
 		if (content)
 		{
 			descFileName = descFileName_txt;
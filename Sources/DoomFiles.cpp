@@ -16,6 +16,9 @@
 #include <QFileInfo>
 #include <QRegularExpression>
 
+#include <array>
+#include <algorithm>  // lower_bound
+
 
 namespace doom {
 
@@ -350,23 +353,111 @@ static const GameIdentification Harmony =
 	.chocolateID = "unknown",
 };
 
+static const GameIdentification * const allGames [] =
+{
+	&Doom1_Shareware, &Doom1_Registered, &Doom1_Ultimate, &Doom1_Ultimate_XBox, &Doom1_BFG, &Doom1_KEX, &Doom1_Unity,
+	&Doom2, &Doom2_XBox, &Doom2_BFG, &Doom2_KEX, &Doom2_Unity,
+	&Doom2_TNT, &Doom2_TNT_KEX, &Doom2_TNT_Unity, &Doom2_Plutonia, &Doom2_Plutonia_KEX, &Doom2_Plutonia_Unity,
+	&Heretic_Shareware, &Heretic,
+	&Hexen_Shareware, &Hexen, &Hexen_Deathkings,
+	&Freedoom_Demo, &Freedoom_Phase1, &Freedoom_Phase2, &FreeDM, &Blasphemer,
+	&Strife, &Strife_Veteran, &Chex_Quest, &Chex_Quest3, &Harmony,
+};
+
 } // namespace game
 
+GameIdentification findGameByID( const QString & gzdoomID )
+{
+	if (gzdoomID.isEmpty())
+		return {};
+
+	for (const GameIdentification * game : game::allGames)
+		if (gzdoomID == QLatin1String( game->gzdoomID ))
+			return *game;
+
+	return {};
+}
+
 
 //----------------------------------------------------------------------------------------------------------------------
 // detection of known games from IWAD
 
-template< size_t count >
-static bool containsAllOf( const QSet< QString > & set, const std::array< const char *, count > & elems )
+// All the lumps that the decision tree in identifyGame() looks at.
+// Only these are recorded while reading the IWAD, the rest of its lumps is not needed.
+#define FOR_EACH_MARKER_LUMP( X ) \
+	X( I_RELB, "I_RELB" ) X( FXAA_F, "FXAA_F" ) X( MAP35, "MAP35" ) X( TITLE, "TITLE" ) \
+	X( BLASPHEM, "BLASPHEM" ) X( MUS_E1M1, "MUS_E1M1" ) X( E2M1, "E2M1" ) X( MAP60, "MAP60" ) \
+	X( CLUS1MSG, "CLUS1MSG" ) X( MAP01, "MAP01" ) X( WINNOWR, "WINNOWR" ) X( MAP40, "MAP40" ) \
+	X( E1M1, "E1M1" ) X( FREEDOOM, "FREEDOOM" ) X( CYCLA1, "CYCLA1" ) X( FLMBA1, "FLMBA1" ) \
+	X( MAPINFO, "MAPINFO" ) X( W94_1, "W94_1" ) X( POSSH0M0, "POSSH0M0" ) X( E4M1, "E4M1" ) \
+	X( DPHOOF, "DPHOOF" ) X( BFGGA0, "BFGGA0" ) X( E4M2, "E4M2" ) X( E1M10, "E1M10" ) \
+	X( SEWERS, "SEWERS" ) X( DMENUPIC, "DMENUPIC" ) X( M_ACPT, "M_ACPT" ) X( M_CAN, "M_CAN" ) \
+	X( M_EXITO, "M_EXITO" ) X( M_CHG, "M_CHG" ) X( GAMECONF, "GAMECONF" ) X( ENDSTRF, "ENDSTRF" ) \
+	X( MAP33, "MAP33" ) X( _0HAWK01, "0HAWK01" ) X( _0CARA3, "0CARA3" ) X( _0NOSE1, "0NOSE1" ) \
+	X( FREEDM, "FREEDM" ) X( REDTNT2, "REDTNT2" ) X( DMAPINFO, "DMAPINFO" ) X( CAMO1, "CAMO1" ) \
+	X( CWILV32, "CWILV32" )
+
+namespace marker {
+
+enum Index : uint
+{
+ #define MARKER_INDEX( id, name ) id,
+	FOR_EACH_MARKER_LUMP( MARKER_INDEX )
+ #undef MARKER_INDEX
+	Count
+};
+static_assert( Count <= 64, "GameSignature::Mask has only 64 bits" );
+
+struct Entry
 {
-	for (const char * elem : elems)
-		if (!set.contains( elem ))
-			return false;
-	return true;
+	LumpName name;
+	Index index;
+};
+
+// sorted by name, so that each lump can be looked up by a binary search
+static constexpr auto sortedEntries = []()
+{
+	std::array< Entry, Count > entries = {{
+	 #define MARKER_ENTRY( id, name ) { makeLumpName( name ), id },
+		FOR_EACH_MARKER_LUMP( MARKER_ENTRY )
+	 #undef MARKER_ENTRY
+	}};
+	for (size_t i = 1; i < entries.size(); ++i)  // insertion sort, std::sort is not constexpr in C++17
+		for (size_t j = i; j > 0 && entries[j].name < entries[j-1].name; --j)
+		{
+			Entry tmp = entries[j];
+			entries[j] = entries[j-1];
+			entries[j-1] = tmp;
+		}
+	return entries;
+}();
+
+template< typename ... Indexes >
+constexpr GameSignature::Mask markerMask( Indexes ... indexes )
+{
+	return ((GameSignature::Mask(1) << indexes) | ...);
 }
 
-GameIdentification identifyGame( const QSet< QString > & lumps )
+} // namespace marker
+
+#undef FOR_EACH_MARKER_LUMP
+
+void GameSignature::addLump( LumpName lumpName )
 {
+	auto iter = std::lower_bound( marker::sortedEntries.begin(), marker::sortedEntries.end(), lumpName,
+		[]( const marker::Entry & entry, LumpName name ) { return entry.name < name; }
+	);
+	if (iter != marker::sortedEntries.end() && iter->name == lumpName)
+	{
+		_presentMarkers |= Mask(1) << iter->index;
+	}
+}
+
+GameIdentification identifyGame( const GameSignature & signature )
+{
+	using namespace marker;
+	auto has = [ &signature ]( auto ... markers ) { return signature.containsAll( markerMask( markers ... ) ); };
+
 	// Hand-crafted decision tree for detecting IWADs based on the lumps they contain.
 	// Based on https://github.com/ZDoom/gzdoom/blob/master/wadsrc_extra/static/iwadinfo.txt
 	//
@@ -374,19 +465,19 @@ GameIdentification identifyGame( const QSet< QString > & lumps )
 	// It may be slightly slower, but the other way around we risk misclassifying items with only few specific lumps like:
 	// strife.veteran:  "MAP35", "I_RELB", "FXAA_F"
 
-	if (lumps.contains("I_RELB") && lumps.contains("FXAA_F") && lumps.contains("MAP35"))
+	if (has( I_RELB, FXAA_F, MAP35 ))
 	{
 		return game::Strife_Veteran;
 	}
-	else if (lumps.contains("TITLE"))  // Heretic & Hexen
+	else if (has( TITLE ))  // Heretic & Hexen
 	{
-		if (lumps.contains("BLASPHEM"))
+		if (has( BLASPHEM ))
 		{
 			return game::Blasphemer;
 		}
-		else if (lumps.contains("MUS_E1M1"))
+		else if (has( MUS_E1M1 ))
 		{
-			if (lumps.contains("E2M1"))
+			if (has( E2M1 ))
 			{
 				return game::Heretic;
 			}
@@ -395,13 +486,13 @@ GameIdentification identifyGame( const QSet< QString > & lumps )
 				return game::Heretic_Shareware;
 			}
 		}
-		else if (lumps.contains("MAP60") && lumps.contains("CLUS1MSG"))
+		else if (has( MAP60, CLUS1MSG ))
 		{
 			return game::Hexen_Deathkings;
 		}
-		else if (lumps.contains("MAP01") && lumps.contains("WINNOWR"))
+		else if (has( MAP01, WINNOWR ))
 		{
-			if (lumps.contains("MAP40"))
+			if (has( MAP40 ))
 			{
 				return game::Hexen;
 			}
@@ -411,11 +502,11 @@ GameIdentification identifyGame( const QSet< QString > & lumps )
 			}
 		}
 	}
-	else if (lumps.contains("E1M1"))  // Doom1-based games
+	else if (has( E1M1 ))  // Doom1-based games
 	{
-		if (lumps.contains("FREEDOOM"))
+		if (has( FREEDOOM ))
 		{
-			if (lumps.contains("E2M1"))
+			if (has( E2M1 ))
 			{
 				return game::Freedoom_Phase1;
 			}
@@ -424,29 +515,29 @@ GameIdentification identifyGame( const QSet< QString > & lumps )
 				return game::Freedoom_Demo;
 			}
 		}
-		else if (lumps.contains("CYCLA1") && lumps.contains("FLMBA1") && lumps.contains("MAPINFO"))
+		else if (has( CYCLA1, FLMBA1, MAPINFO ))
 		{
 			return game::Chex_Quest3;
 		}
-		else if (lumps.contains("W94_1") && lumps.contains("POSSH0M0") && lumps.contains("E4M1"))
+		else if (has( W94_1, POSSH0M0, E4M1 ))
 		{
 			return game::Chex_Quest;
 		}
-		else if (containsAllOf<3>( lumps, { "E2M1", "DPHOOF", "BFGGA0" } ))  // full Doom1 variants - can add "E3M1", "HEADA1", "CYBRA1", "SPIDA1D1" for additional verification
+		else if (has( E2M1, DPHOOF, BFGGA0 ))  // full Doom1 variants - can add "E3M1", "HEADA1", "CYBRA1", "SPIDA1D1" for additional verification
 		{
-			if (lumps.contains("E4M2"))  // with 4th episode
+			if (has( E4M2 ))  // with 4th episode
 			{
-				if (lumps.contains("E1M10") && lumps.contains("SEWERS"))
+				if (has( E1M10, SEWERS ))
 				{
 					return game::Doom1_Ultimate_XBox;
 				}
-				else if (lumps.contains("DMENUPIC"))  // re-releases
+				else if (has( DMENUPIC ))  // re-releases
 				{
-					if (containsAllOf<4>( lumps, { "M_ACPT", "M_CAN", "M_EXITO", "M_CHG" } ))
+					if (has( M_ACPT, M_CAN, M_EXITO, M_CHG ))
 					{
 						return game::Doom1_BFG;
 					}
-					else if (lumps.contains("GAMECONF"))  // KEX
+					else if (has( GAMECONF ))  // KEX
 					{
 						return game::Doom1_KEX;
 					}
@@ -470,31 +561,31 @@ GameIdentification identifyGame( const QSet< QString > & lumps )
 			return game::Doom1_Shareware;
 		}
 	}
-	else if (lumps.contains("MAP01"))  // Doom2-based games
+	else if (has( MAP01 ))  // Doom2-based games
 	{
-		if (lumps.contains("ENDSTRF") && lumps.contains("MAP33"))
+		if (has( ENDSTRF, MAP33 ))
 		{
 			return game::Strife;
 		}
-		else if (lumps.contains("0HAWK01") && lumps.contains("0CARA3") && lumps.contains("0NOSE1"))
+		else if (has( _0HAWK01, _0CARA3, _0NOSE1 ))
 		{
 			return game::Harmony;
 		}
-		else if (lumps.contains("FREEDOOM"))
+		else if (has( FREEDOOM ))
 		{
 			return game::Freedoom_Phase2;
 		}
-		else if (lumps.contains("FREEDM"))
+		else if (has( FREEDM ))
 		{
 			return game::FreeDM;
 		}
-		else if (lumps.contains("REDTNT2"))  // TNT
+		else if (has( REDTNT2 ))  // TNT
 		{
-			if (lumps.contains("GAMECONF"))  // KEX
+			if (has( GAMECONF ))  // KEX
 			{
 				return game::Doom2_TNT_KEX;
 			}
-			else if (lumps.contains("DMAPINFO"))  // Unity
+			else if (has( DMAPINFO ))  // Unity
 			{
 				return game::Doom2_TNT_Unity;
 			}
@@ -503,13 +594,13 @@ GameIdentification identifyGame( const QSet< QString > & lumps )
 				return game::Doom2_TNT;
 			}
 		}
-		else if (lumps.contains("CAMO1"))  // Plutonia
+		else if (has( CAMO1 ))  // Plutonia
 		{
-			if (lumps.contains("GAMECONF"))  // KEX
+			if (has( GAMECONF ))  // KEX
 			{
 				return game::Doom2_Plutonia_KEX;
 			}
-			else if (lumps.contains("DMAPINFO"))  // Unity
+			else if (has( DMAPINFO ))  // Unity
 			{
 				return game::Doom2_Plutonia_Unity;
 			}
@@ -520,17 +611,17 @@ GameIdentification identifyGame( const QSet< QString > & lumps )
 		}
 		else  // Doom2 variants
 		{
-			if (lumps.contains("CWILV32") && lumps.contains("MAP33"))
+			if (has( CWILV32, MAP33 ))
 			{
 				return game::Doom2_XBox;
 			}
-			else if (lumps.contains("DMENUPIC"))  // re-releases
+			else if (has( DMENUPIC ))  // re-releases
 			{
-				if (containsAllOf<4>( lumps, { "M_ACPT", "M_CAN", "M_EXITO", "M_CHG" } ))
+				if (has( M_ACPT, M_CAN, M_EXITO, M_CHG ))
 				{
 					return game::Doom2_BFG;
 				}
-				else if (lumps.contains("GAMECONF"))  // KEX
+				else if (has( GAMECONF ))  // KEX
 				{
 					return game::Doom2_KEX;
 				}
@@ -11,6 +11,8 @@
 
 #include "Essential.hpp"
 
+#include "Utils/WADFormat.hpp"  // LumpName
+
 #include <QString>
 #include <QStringList>
 class QFileInfo;
@@ -45,8 +47,31 @@ struct GameIdentification
 	const char * gzdoomID = nullptr;     ///< GZDoom-based game ID used as subdirectory for game data
 	const char * chocolateID = nullptr;  ///< ChocolateDoom-based game ID used as subdirectory for game data
 };
-/// Given a list of lump names found in an IWAD, returns what game it probably belongs to.
-GameIdentification identifyGame( const QSet< QString > & lumpNames );
+/// Records which of the lumps relevant for the game identification an IWAD contains.
+/** Each of these marker lumps is represented by one bit, so the identification is just a few bit mask tests
+  * and the reader doesn't need to collect all the lump names of the IWAD. */
+class GameSignature {
+
+ public:
+
+	using Mask = uint64_t;
+
+	/// Marks the lump as present if it's one of the marker lumps, otherwise does nothing.
+	void addLump( LumpName lumpName );
+
+	bool containsAll( Mask markerMask ) const  { return (_presentMarkers & markerMask) == markerMask; }
+
+ private:
+
+	Mask _presentMarkers = 0;
+
+};
+
+/// Given the marker lumps found in an IWAD, returns what game it probably belongs to.
+GameIdentification identifyGame( const GameSignature & signature );
+
+/// Returns the known game with this GZDoom-based game ID, or an empty identification if there is no such game.
+GameIdentification findGameByID( const QString & gzdoomID );
 
 namespace game
 {
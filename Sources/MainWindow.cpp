@@ -36,6 +36,8 @@
 #include "Utils/WADReader.hpp"
 #include "Utils/Pk3Reader.hpp"
 #include "Utils/DoomModBundles.hpp"
+#include "Utils/BinaryCacheFile.hpp"
+#include "Utils/ThreadUtils.hpp"  // backgroundThreadPool
 #include "Utils/WidgetUtils.hpp"
 #include "Utils/MiscUtils.hpp"  // areScreenCoordinatesValid, makeFileFilter, splitCommandLineArguments
 #include "Utils/ErrorHandling.hpp"
@@ -49,12 +51,21 @@
 #include <QShortcut>
 #include <QTimer>
 #include <QProcess>  // startDetached
+#include <QElapsedTimer>
+#include <QThreadPool>
+#include <QThread>
+#include <QSet>
 
 
 //======================================================================================================================
 
 static const char defaultOptionsFileName [] = "options.json";
-static const char defaultCacheFileName [] = "file_info_cache.json";
+static const char defaultCacheFileName [] = "file_info_cache.bin";
+static const char legacyCacheFileName [] = "file_info_cache.json";
+static const char cacheJournalFileName [] = "file_info_cache.journal";
+
+// when the journal grows bigger than this, the cache file is rewritten with all the changes and the journal is deleted
+static constexpr qint64 cacheJournalSizeLimit = 1 * 1024 * 1024;
 
 enum EnvVarsColumn
 {
@@ -428,46 +439,87 @@ bool MainWindow::canAnyOfTheModsContainMapNames( const PtrList<Mod> & mods, int
 	return false;
 }
 
-QStringList MainWindow::getUniqueMapNamesFromSelectedFiles() const
+QMap< QString, QString > MainWindow::getUniqueMapNamesFromSelectedFiles() const
 {
-	QMap< QString, int > uniqueMapNames;  // we cannot use QSet because that one is unordered and we need to retain order
+	// First collect all the files, so that they can be read all at once in parallel.
+	QStringList wadFilePaths;
+	QStringList pk3FilePaths;
+	QList< std::pair< bool, int > > loadOrder;  // is it WAD, index in the corresponding list
 
-	forEachSelectedFileWithExpandedDMBs( [ &uniqueMapNames ]( const QString & filePath )
+	forEachSelectedFileWithExpandedDMBs( [ & ]( const QString & filePath )
 	{
 		QFileInfo fileInfo( filePath );
 
 		if (filePath.isEmpty() || !fileInfo.isFile())
 			return;
 
-		doom::MapInfo mapInfo;
-
 		// TODO: support extracted dirs
 		if (doom::isWAD( fileInfo ))
 		{
-			const doom::UncertainWadInfo & wadInfo = g_cachedWadInfo.getFileInfo( filePath );
-			if (wadInfo.status != ReadStatus::Success)
-				return;
-			mapInfo = std::move( wadInfo.mapInfo );
+			loadOrder.append({ true, int( wadFilePaths.size() ) });
+			wadFilePaths.append( filePath );
 		}
 		else if (doom::isZip( fileInfo ))
 		{
-			const doom::UncertainPk3Info & pk3Info = g_cachedPk3Info.getFileInfo( filePath );
-			if (pk3Info.status != ReadStatus::Success)
-				return;
-			mapInfo = std::move( pk3Info.mapInfo );
+			loadOrder.append({ false, int( pk3FilePaths.size() ) });
+			pk3FilePaths.append( filePath );
+		}
+		// else cannot read map names from this file type
+	});
+
+	const QList< doom::UncertainWadInfo > wadInfos = g_cachedWadInfo.getFileInfos( wadFilePaths );
+	const QList< doom::UncertainPk3Info > pk3Infos = g_cachedPk3Info.getFileInfos( pk3FilePaths );
+
+	QMap< QString, QString > uniqueMapNames;  // map name -> title, we cannot use QHash because we need to retain order
+
+	// merge the results in the original load order
+	for (const auto & [isWAD, idx] : loadOrder)
+	{
+		const doom::MapInfo * mapInfo = nullptr;
+
+		if (isWAD)
+		{
+			const doom::UncertainWadInfo & wadInfo = wadInfos[ idx ];
+			if (wadInfo.status != ReadStatus::Success)
+				continue;
+			mapInfo = &wadInfo.mapInfo;
 		}
 		else
 		{
-			return;  // cannot read map names from this file type
+			const doom::UncertainPk3Info & pk3Info = pk3Infos[ idx ];
+			if (pk3Info.status != ReadStatus::Success)
+				continue;
+			mapInfo = &pk3Info.mapInfo;
 		}
 
-		for (const QString & mapName : as_const( mapInfo.mapNames ))
+		for (const QString & mapName : mapInfo->mapNames)
 		{
-			uniqueMapNames.insert( mapName.toUpper(), 0 );  // the 0 doesn't matter
+			QString & title = uniqueMapNames[ mapName.toUpper() ];
+			// files loaded later override the map definitions of the previous ones, but not every file defines a title
+			const doom::MapDefinition * mapDef = mapInfo->findMapDef( mapName );
+			if (mapDef && !mapDef->title.isEmpty())
+				title = mapDef->title;
 		}
-	});
+	}
 
-	return uniqueMapNames.keys();
+	return uniqueMapNames;
+}
+
+// Requests the info of all the mods of a preset, including the unchecked ones, to be read in the background,
+// so that it's already cached when the user checks them.
+void MainWindow::prefetchModsInfo( const Preset & preset )
+{
+	for (const Mod & mod : preset.mods)
+	{
+		if (!canContainMapNames( mod ))
+			continue;
+
+		QFileInfo fileInfo( mod.path );
+		if (doom::isWAD( fileInfo ))
+			g_cachedWadInfo.getFileInfoAsync( mod.path );
+		else if (doom::isZip( fileInfo ))
+			g_cachedPk3Info.getFileInfoAsync( mod.path );
+	}
 }
 
 int MainWindow::getStartingMapIndexFromSelectedFiles() const
@@ -866,6 +918,8 @@ MainWindow::MainWindow()
 		/*makeDisplayString*/ []( const Preset & preset ) { return preset.name; }
 	)
 {
+	startupTimer.start();
+
 	ui = new Ui::MainWindow;
 	ui->setupUi( this );
 	presetSearchPanel = new SearchPanel( ui->searchShowBtn, ui->searchLine, ui->caseSensitiveChkBox, ui->regexChkBox );
@@ -948,6 +1002,27 @@ MainWindow::MainWindow()
 	connect( ui->demoFileLine_record, &QLineEdit::textChanged, this, &ThisClass::onDemoFileChanged_record );
 	connect( ui->demoFileLine_resume, &QLineEdit::textChanged, this, &ThisClass::onDemoFileChanged_resume );
 
+	// setup automatic updates of the lists populated from directories
+
+	connect( &iwadDirWatcher, &DirWatcher::dirChanged, this, &ThisClass::onIWADDirChanged );
+	connect( &configDirWatcher, &DirWatcher::dirChanged, this, [this]()
+	{
+		configDirScanner.startScan( activeConfigDir, /*recursively*/false, pathConvertor );
+	});
+	connect( &saveDirWatcher, &DirWatcher::dirChanged, this, [this]()
+	{
+		saveDirScanner.startScan( activeSaveDir, /*recursively*/false, pathConvertor );
+	});
+	connect( &demoDirWatcher, &DirWatcher::dirChanged, this, [this]()
+	{
+		demoDirScanner.startScan( activeDemoDir, /*recursively*/false, pathConvertor );
+	});
+
+	connect( &iwadDirScanner, &DirScanner::snapshotReady, this, &ThisClass::updateIWADsFromDir );
+	connect( &configDirScanner, &DirScanner::snapshotReady, this, &ThisClass::updateConfigFilesFromDir );
+	connect( &saveDirScanner, &DirScanner::snapshotReady, this, &ThisClass::updateSaveFilesFromDir );
+	connect( &demoDirScanner, &DirScanner::snapshotReady, this, &ThisClass::updateDemoFilesFromDir );
+
 	ui->compatModeCmbBox->addItem("");  // always have this empty item there, so that we can restore index 0
 
 	// setup alternative path validators
@@ -1344,6 +1419,8 @@ void MainWindow::initAppDataDir()
 
 	optionsFilePath = appDataDir.filePath( defaultOptionsFileName );
 	cacheFilePath = appDataDir.filePath( defaultCacheFileName );
+	legacyCacheFilePath = appDataDir.filePath( legacyCacheFileName );
+	cacheJournalFilePath = appDataDir.filePath( cacheJournalFileName );
 }
 
 // This is called when the window layout is initialized and widget sizes calculated,
@@ -1357,6 +1434,10 @@ void MainWindow::showEvent( QShowEvent * event )
 
 	initAppDataDir();
 
+	// The cache doesn't affect the appearance, so it can be loaded in parallel with parsing the options
+	// and drawing the window.
+	startCacheLoading();
+
 	// Options loading is now split into two phases.
 	// The reason is that appearance settings and geometry need to be applied before the window is drawn
 	// for the first time (so that the window does not appear white and then changes to dark or is moved/resized),
@@ -1397,13 +1478,20 @@ void MainWindow::onWindowShown()
 {
 	// The potentially most expensive file-system operations like reading exe files are done here,
 	// just to make sure the application doesn't hang before even showing anything.
-	// It would be best to do this asynchronously, but there has not been any reported problems with is,
-	// so it's probably fine.
+	// The cache is loaded in the background since showEvent(), and the files that are not needed right now
+	// are read in the background after the options are loaded.
 
 	// cache needs to be loaded first, because loadOptions() already needs it
-	if (fs::isValidFile( cacheFilePath ))
+	waitForCacheLoading();
+	if (!fs::isValidFile( cacheFilePath ) && fs::isValidFile( legacyCacheFilePath ))
+	{
+		// convert the cache of an older version to the new format right away
+		if (loadLegacyCache( legacyCacheFilePath ))
+			saveCache( cacheFilePath );
+	}
+	if (shouldCompactCache())
 	{
-		loadCache( cacheFilePath );
+		startCacheCompaction();
 	}
 
 	auto optionsDocDeleter = atScopeEndDo( [ this ](){ parsedOptionsDoc.reset(); } );  // delete when no longer needed
@@ -1464,6 +1552,11 @@ void MainWindow::onWindowShown()
 
 	// setup an update timer
 	startTimer( 1000 );
+
+	logInfo() << "time to interactive: " << startupTimer.elapsed() << "ms";
+
+	// the selected preset is already restored, prepare the others in case the user switches to them
+	startCacheWarmUp();
 }
 
 void MainWindow::timerEvent( QTimerEvent * event )  // called once per second
@@ -1478,9 +1571,11 @@ void MainWindow::timerEvent( QTimerEvent * event )  // called once per second
 	constexpr uint dirUpdateDelay = 2;
  #endif
 
+	// the lists are normally updated by the directory watchers when something changes,
+	// frequent updates are needed only for the directories that cannot be watched
 	if (tickCount % dirUpdateDelay == 0)
 	{
-		updateListsFromDirs();
+		pollUnwatchedDirs();
 	}
 
 	if (tickCount % 10 == 0)
@@ -1492,9 +1587,10 @@ void MainWindow::timerEvent( QTimerEvent * event )  // called once per second
 			optionsNeedUpdate = false;
 		}
 
+		// only the changed entries are written, so the cost doesn't depend on the size of the cache
 		if (isCacheDirty())
 		{
-			saveCache( cacheFilePath );
+			saveCacheChanges( cacheJournalFilePath );
 		}
 	}
 }
@@ -1504,8 +1600,14 @@ void MainWindow::closeEvent( QCloseEvent * event )
 	if (!optionsCorrupted)  // don't overwrite existing file with empty data, just because there was a syntax error
 		saveOptions( optionsFilePath );
 
+	waitForCacheLoading();  // in case the window is closed before it has even finished loading
+	finishCacheCompaction( /*wait*/ true );
 	if (isCacheDirty())
-		saveCache( cacheFilePath );
+		saveCacheChanges( cacheJournalFilePath );
+
+	g_cachedExeInfo.logStats();
+	g_cachedWadInfo.logStats();
+	g_cachedPk3Info.logStats();
 
  #if IS_WINDOWS
 	systemThemeWatcher.stop(500);
@@ -1668,26 +1770,338 @@ int MainWindow::askForEngineInfoRefresh()
 	return answer;
 }
 
+// The cache entries are read lazily from the mapped file, so each cache keeps the file open until it's replaced.
+static void attachBinaryCache( const std::shared_ptr< BinaryCacheFile > & cacheFile )
+{
+	g_cachedExeInfo.attachBinaryCache( cacheFile, "exe_info" );
+	g_cachedWadInfo.attachBinaryCache( cacheFile, "wad_info" );
+	g_cachedPk3Info.attachBinaryCache( cacheFile, "pk3_info" );
+}
+
 bool MainWindow::isCacheDirty() const
 {
 	return g_cachedExeInfo.isDirty()
-	//	|| g_cachedWadInfo.isDirty()
+	    || g_cachedWadInfo.isDirty()
 	    || g_cachedPk3Info.isDirty()
 	;
 }
 
+static bool cachesNeedCompaction()
+{
+	return g_cachedExeInfo.needsCompaction()
+	    || g_cachedWadInfo.needsCompaction()
+	    || g_cachedPk3Info.needsCompaction()
+	;
+}
+
+#if IS_WINDOWS
+
+static void detachBinaryCache()
+{
+	g_cachedExeInfo.detachBinaryCache();
+	g_cachedWadInfo.detachBinaryCache();
+	g_cachedPk3Info.detachBinaryCache();
+}
+
+/// Moves the new cache file over the currently attached one.
+/** Windows doesn't allow replacing a file that is mapped, so the old file is detached only now and the rename waits
+  * until the lookups that still hold the old file in other threads finish. */
+static QString replaceAttachedCacheFile( const QString & newFilePath, const QString & filePath )
+{
+	const std::weak_ptr< const BinaryCacheFile > oldFiles [] = {
+		g_cachedExeInfo.binaryCacheFile(),
+		g_cachedWadInfo.binaryCacheFile(),
+		g_cachedPk3Info.binaryCacheFile(),
+	};
+	detachBinaryCache();
+
+	constexpr qint64 maxWait_ms = 1000;
+	QElapsedTimer timer;
+	timer.start();
+	while (true)
+	{
+		bool released = true;
+		for (const auto & oldFile : oldFiles)
+			released &= oldFile.expired();
+		if (released && (!QFile::exists( filePath ) || QFile::remove( filePath )) && QFile::rename( newFilePath, filePath ))
+		{
+			return {};
+		}
+		if (timer.elapsed() >= maxWait_ms)
+		{
+			QFile::remove( newFilePath );
+			return "Could not replace file "%filePath%", it's still in use";
+		}
+		QThread::msleep( 10 );
+	}
+}
+
+#endif // IS_WINDOWS
+
+/// Writes all the entries into a new cache file and deletes the journal. Can be called from any thread.
+/** Returns an error message or empty string on success. */
+static QString writeCacheFile( const QString & filePath, const QString & journalFilePath )
+{
+	BinaryCacheWriter cacheWriter;
+	g_cachedExeInfo.serialize( cacheWriter, "exe_info" );
+	g_cachedWadInfo.serialize( cacheWriter, "wad_info" );
+	g_cachedPk3Info.serialize( cacheWriter, "pk3_info" );
+	QByteArray content = cacheWriter.finish();
+
+	// The old file stays attached while the new one is being written, so that the entries that are only in the file
+	// don't have to be read again from the WADs and pk3s in the meantime.
+ #if IS_WINDOWS
+	QString error = fs::updateFileSafely( filePath % ".new", content );
+	if (error.isEmpty())
+	{
+		error = replaceAttachedCacheFile( filePath % ".new", filePath );
+	}
+ #else
+	// The old file is replaced by a rename, so the readers that still have it mapped keep seeing the old content.
+	QString error = fs::updateFileSafely( filePath, content );
+ #endif
+	if (error.isEmpty())
+	{
+		// Everything from the journal is in the new file now. If the application crashes before the journal
+		// is deleted, the journal is replayed over the new file, which doesn't change anything.
+		QFile::remove( journalFilePath );
+	}
+
+	// Swap in whatever is now on the disk. Each cache switches to the new file at once,
+	// the lookups in progress keep the old file mapped until they finish.
+	if (auto cacheFile = BinaryCacheFile::open( filePath ))
+	{
+		attachBinaryCache( cacheFile );
+	}
+
+	return error;
+}
+
 bool MainWindow::saveCache( const QString & filePath )
 {
-	QJsonObject jsRoot;
-	jsRoot["exe_info"] = g_cachedExeInfo.serialize();
-	//jsRoot["wad_info"] = g_cachedWadInfo.serialize();  // not needed, WAD parsing is probably faster than JSON parsing
-	jsRoot["pk3_info"] = g_cachedPk3Info.serialize();
+	finishCacheCompaction( /*wait*/ true );
+
+	QString error = writeCacheFile( filePath, cacheJournalFilePath );
+	if (!error.isEmpty())
+	{
+		reportRuntimeError( "Error saving file-info cache", error );
+	}
+
+	return error.isEmpty();
+}
+
+void MainWindow::startCacheLoading()
+{
+	// mod libraries often get reorganized, don't re-read the files just because they were moved or renamed
+	g_cachedWadInfo.setContentMatching( true );
+	g_cachedPk3Info.setContentMatching( true );
+
+	auto promise = std::make_shared< std::promise< void > >();
+	cacheLoading = promise->get_future();
+	backgroundThreadPool().start( [ this, promise ]()
+	{
+		if (fs::isValidFile( cacheFilePath ))
+		{
+			loadCache( cacheFilePath );
+		}
+		// the changes made after the cache file was last written whole
+		if (fs::isValidFile( cacheJournalFilePath ))
+		{
+			replayCacheChanges( cacheJournalFilePath );
+		}
+		promise->set_value();
+	});
+}
+
+void MainWindow::waitForCacheLoading()
+{
+	if (cacheLoading.valid())
+	{
+		QElapsedTimer timer;
+		timer.start();
+
+		cacheLoading.get();  // makes the future invalid again
+
+		logDebug() << "waited " << timer.elapsed() << "ms for the file-info cache to load";
+	}
+}
+
+// Reads the info of the files of all presets in the background, so that when the user selects another preset
+// right after the start, its map names are already in the cache.
+void MainWindow::startCacheWarmUp()
+{
+	QStringList filePaths;
+	for (const Preset & preset : presetModel)
+	{
+		for (const Mod & mod : preset.mods)
+		{
+			if (!mod.isSeparator && !mod.isCmdArg)
+			{
+				filePaths.append( mod.path );
+			}
+		}
+	}
+	for (const IWAD & iwad : iwadModel)
+	{
+		filePaths.append( iwad.path );
+	}
+
+	// The interactive requests started in the meantime are queued with a higher priority.
+	backgroundThreadPool().start( [ filePaths = std::move( filePaths ) ]()
+	{
+		QElapsedTimer timer;
+		timer.start();
+
+		// don't take the CPU from the things the user is waiting for
+		QThread::currentThread()->setPriority( QThread::LowPriority );
+
+		// even checking the file types accesses the file system, so it's done here and not in the GUI thread
+		QSet< QString > uniquePaths;
+		QStringList wadFilePaths;
+		QStringList pk3FilePaths;
+		for (const QString & filePath : filePaths)
+		{
+			if (uniquePaths.contains( filePath ))
+				continue;
+			uniquePaths.insert( filePath );
+
+			if (!canContainMapNames( filePath ))
+				continue;
+
+			QFileInfo fileInfo( filePath );
+			if (doom::isWAD( fileInfo ))
+				wadFilePaths.append( filePath );
+			else if (doom::isZip( fileInfo ))
+				pk3FilePaths.append( filePath );
+		}
+
+		// One file at a time in this thread only. getFileInfos() would spread the reads over the global pool,
+		// whose threads don't have the lowered priority, and would occupy the threads that the interactive
+		// parallel operations need.
+		for (const QString & filePath : wadFilePaths)
+			g_cachedWadInfo.getFileInfo( filePath );
+		for (const QString & filePath : pk3FilePaths)
+			g_cachedPk3Info.getFileInfo( filePath );
+
+		QThread::currentThread()->setPriority( QThread::NormalPriority );  // the thread will be re-used by other tasks
+
+		logInfo( u"MainWindow" ) << "file-info cache warmed up in " << timer.elapsed() << "ms ("
+		                         << wadFilePaths.size() + pk3FilePaths.size() << " files)";
+	}, taskPriority::Low );
+}
+
+bool MainWindow::saveCacheChanges( const QString & journalFilePath )
+{
+	// the compaction would delete the journal together with the new changes
+	if (!finishCacheCompaction( /*wait*/ false ))
+	{
+		return false;  // the changes stay marked and will be written next time
+	}
+
+	BinaryCacheJournalWriter journalWriter;
+	g_cachedExeInfo.serializeChanges( journalWriter, "exe_info" );
+	g_cachedWadInfo.serializeChanges( journalWriter, "wad_info" );
+	g_cachedPk3Info.serializeChanges( journalWriter, "pk3_info" );
+
+	if (journalWriter.recordCount() > 0)
+	{
+		QString error = journalWriter.appendTo( journalFilePath );
+		if (!error.isEmpty())
+		{
+			reportRuntimeError( "Error saving file-info cache", error );
+			return false;
+		}
+	}
+
+	if (shouldCompactCache())
+	{
+		startCacheCompaction();
+	}
+
+	return true;
+}
+
+bool MainWindow::replayCacheChanges( const QString & journalFilePath )
+{
+	QElapsedTimer timer;
+	timer.start();
+
+	int recordCount = 0;
+	bool replayed = replayBinaryCacheJournal( journalFilePath, [ &recordCount ]( QStringView sectionName, const BinaryCacheRecord & record )
+	{
+		if (sectionName == u"exe_info")
+			g_cachedExeInfo.replayJournalRecord( record );
+		else if (sectionName == u"wad_info")
+			g_cachedWadInfo.replayJournalRecord( record );
+		else if (sectionName == u"pk3_info")
+			g_cachedPk3Info.replayJournalRecord( record );
+		recordCount++;
+	});
 
-	QJsonDocument jsonDoc( jsRoot );
-	return writeJsonToFile( jsonDoc, filePath, "file-info cache" );
+	logDebug() << "file-info cache journal replayed in " << timer.elapsed() << "ms (" << recordCount << " records)";
+	return replayed;
+}
+
+bool MainWindow::shouldCompactCache() const
+{
+	return QFileInfo( cacheJournalFilePath ).size() > cacheJournalSizeLimit || cachesNeedCompaction();
+}
+
+void MainWindow::startCacheCompaction()
+{
+	if (cacheCompaction.valid())
+	{
+		return;  // already running
+	}
+
+	logDebug() << "rewriting the file-info cache in the background";
+
+	auto promise = std::make_shared< std::promise< QString > >();
+	cacheCompaction = promise->get_future();
+	backgroundThreadPool().start( [ promise, filePath = cacheFilePath, journalFilePath = cacheJournalFilePath ]()
+	{
+		promise->set_value( writeCacheFile( filePath, journalFilePath ) );
+	});
+}
+
+/// Collects the result of the background compaction. Returns false if it's still running and wait is false.
+bool MainWindow::finishCacheCompaction( bool wait )
+{
+	if (!cacheCompaction.valid())
+	{
+		return true;  // none was started
+	}
+	if (!wait && cacheCompaction.wait_for( std::chrono::seconds(0) ) != std::future_status::ready)
+	{
+		return false;
+	}
+
+	QString error = cacheCompaction.get();  // makes the future invalid again
+	if (!error.isEmpty())
+	{
+		reportRuntimeError( "Error saving file-info cache", error );
+	}
+	return true;
 }
 
 bool MainWindow::loadCache( const QString & filePath )
+{
+	QElapsedTimer timer;
+	timer.start();
+
+	auto cacheFile = BinaryCacheFile::open( filePath );
+	if (!cacheFile)
+	{
+		return false;
+	}
+
+	attachBinaryCache( cacheFile );
+
+	logDebug() << "file-info cache opened in " << timer.elapsed() << "ms";
+	return true;
+}
+
+bool MainWindow::loadLegacyCache( const QString & filePath )
 {
 	auto jsonDoc = readJsonFromFile( filePath, "file-info cache", IgnoreEmpty );
 	if (!jsonDoc || !jsonDoc->isValid())
@@ -1705,10 +2119,8 @@ bool MainWindow::loadCache( const QString & filePath )
 
 	if (JsonObjectCtx jsExeCache = jsRoot.getObject( "exe_info", AllowMissing ))
 		g_cachedExeInfo.deserialize( jsExeCache );
-	//if (JsonObjectCtx jsWadCache = jsRoot.getObject( "wad_info", AllowMissing ))
-	//	doom::g_cachedWadInfo.deserialize( jsWadCache );  // not needed, WAD parsing is probably faster than JSON parsing
-	if (JsonObjectCtx jsPk3Cache = jsRoot.getObject( "pk3_info", AllowMissing ))
-		g_cachedPk3Info.deserialize( jsPk3Cache );
+	// The pk3 info in the legacy file contains only the map names, while the binary cache holds a lot more.
+	// Importing it would hide the rest until the files are modified, so the pk3 files will rather be read again.
 
 	return true;
 }
@@ -1894,6 +2306,8 @@ void MainWindow::restorePreset( Preset & preset )
 	// We will rather do it manually when all files to load are restored.
 	restoringPresetFilesInProgress = true;
 
+	prefetchModsInfo( preset );
+
 	restoreSelectedEngine( preset );
 
 	restoreSelectedIWAD( preset );
@@ -2468,6 +2882,11 @@ void MainWindow::runSetupDialog()
 		wdg::setCurrentItemByID( ui->iwadListView, iwadModel, currentIWAD );
 		wdg::selectItemByID( ui->iwadListView, iwadModel, selectedIWAD );
 
+		// The IWAD directory or its settings might have changed. The watcher's subdirectories are reset,
+		// so the directory needs to be read again to find them and to refresh the IWAD list.
+		iwadDirWatcher.setDir( iwadSettings.updateFromDir ? iwadSettings.dir : QString(), iwadSettings.searchSubdirs );
+		onIWADDirChanged();
+
 		disableSelectionCallbacks = false;
 
 		// Regardless whether the index of the selected items actually changed or whether they still exist,
@@ -4937,22 +5356,48 @@ void MainWindow::fillDerivedEngineInfo( DirectList< EngineInfo > & engines, bool
 // to be re-selected, so we have to manually notify the callbacks (which were disabled before) that the selection was
 // reset, so that everything updates correctly.
 
-void MainWindow::updateListsFromDirs()
+void MainWindow::pollUnwatchedDirs()
+{
+	// each of them emits dirChanged() if its directory cannot be watched or hasn't been re-read for a long time
+	iwadDirWatcher.poll();
+	configDirWatcher.poll();
+	saveDirWatcher.poll();
+	demoDirWatcher.poll();
+}
+
+void MainWindow::onIWADDirChanged()
 {
 	if (iwadSettings.updateFromDir)
-		updateIWADsFromDir();
-	updateConfigFilesFromDir();
-	updateSaveFilesFromDir();
-	updateDemoFilesFromDir();
+		iwadDirScanner.startScan( iwadSettings.dir, iwadSettings.searchSubdirs, pathConvertor );
+}
+
+/// Whether a snapshot delivered from the background still belongs to the directory the list is populated from.
+static bool isSnapshotOf( const DirSnapshot & snapshot, const QString & dir, bool recursively )
+{
+	return snapshot.dir == dir && snapshot.recursively == recursively;
 }
 
-void MainWindow::updateIWADsFromDir()
+/** When the snapshot is null, the directory is read immediately, because the callers usually want to select
+  * some of the items right after. Otherwise the snapshot comes from a background scan. */
+void MainWindow::updateIWADsFromDir( const DirSnapshotPtr & snapshot )
 {
+	if (snapshot && (!iwadSettings.updateFromDir || !isSnapshotOf( *snapshot, iwadSettings.dir, iwadSettings.searchSubdirs )))
+	{
+		return;  // the settings have changed while the directory was being read
+	}
+
+	iwadDirWatcher.setDir( iwadSettings.dir, iwadSettings.searchSubdirs );
+
+	DirSnapshotPtr dirContent = snapshot ? snapshot : iwadDirScanner.scanNow( iwadSettings.dir, iwadSettings.searchSubdirs, pathConvertor );
+
+	// the watcher doesn't list the subdirectories itself, so that the GUI thread doesn't walk the whole tree
+	iwadDirWatcher.setSubdirs( dirContent->subdirs );
+
 	// workaround (read the big comment above)
 	int origIwadIdx = wdg::getSelectedItemIndex( ui->iwadListView );
 	disableSelectionCallbacks = true;
 
-	wdg::updateListFromDir( iwadModel, ui->iwadListView, iwadSettings.dir, iwadSettings.searchSubdirs, pathConvertor, doom::canBeIWAD );
+	wdg::updateListFromDir( iwadModel, ui->iwadListView, *dirContent, doom::canBeIWAD );
 
 	if (!iwadSettings.defaultIWAD.isEmpty())
 	{
@@ -4982,7 +5427,7 @@ void MainWindow::resetMapDirModelAndView()
 	ui->mapDirView->setRootIndex( newRootIdx );
 }
 
-void MainWindow::updateConfigFilesFromDir()
+void MainWindow::updateConfigFilesFromDir( const DirSnapshotPtr & snapshot )
 {
 	if (!selectedEngine)
 	{
@@ -4991,12 +5436,21 @@ void MainWindow::updateConfigFilesFromDir()
 
 	const QString & configDir = activeConfigDir;
 
+	if (snapshot && !isSnapshotOf( *snapshot, configDir, /*recursively*/false ))
+	{
+		return;  // the directory has changed while it was being read
+	}
+
+	configDirWatcher.setDir( configDir, /*recursively*/false );
+
+	DirSnapshotPtr dirContent = snapshot ? snapshot : configDirScanner.scanNow( configDir, /*recursively*/false, pathConvertor );
+
 	// workaround (read the big comment above)
 	int origConfigIdx = ui->configCmbBox->currentIndex();
 	disableSelectionCallbacks = true;
 
 	// if the configDir is empty (not set), it will clear the combo box, which is exactly what we want
-	wdg::updateComboBoxFromDir( configModel, ui->configCmbBox, configDir, /*recursively*/false, /*emptyItem*/true, pathConvertor,
+	wdg::updateComboBoxFromDir( configModel, ui->configCmbBox, *dirContent, /*emptyItem*/true,
 		/*isDesiredFile*/[&]( const QFileInfo & file ) { return file.suffix().toLower() == selectedEngine->configFileSuffix(); }
 	);
 
@@ -5010,7 +5464,7 @@ void MainWindow::updateConfigFilesFromDir()
 	}
 }
 
-void MainWindow::updateSaveFilesFromDir()
+void MainWindow::updateSaveFilesFromDir( const DirSnapshotPtr & snapshot )
 {
 	if (!selectedEngine)
 	{
@@ -5019,11 +5473,20 @@ void MainWindow::updateSaveFilesFromDir()
 
 	const QString & saveDir = activeSaveDir;
 
+	if (snapshot && !isSnapshotOf( *snapshot, saveDir, /*recursively*/false ))
+	{
+		return;  // the directory has changed while it was being read
+	}
+
+	saveDirWatcher.setDir( saveDir, /*recursively*/false );
+
+	DirSnapshotPtr dirContent = snapshot ? snapshot : saveDirScanner.scanNow( saveDir, /*recursively*/false, pathConvertor );
+
 	// workaround (read the big comment above)
 	int origSaveIdx = ui->saveFileCmbBox->currentIndex();
 	disableSelectionCallbacks = true;
 
-	wdg::updateComboBoxFromDir( saveModel, ui->saveFileCmbBox, saveDir, /*recursively*/false, /*emptyItem*/false, pathConvertor,
+	wdg::updateComboBoxFromDir( saveModel, ui->saveFileCmbBox, *dirContent, /*emptyItem*/false,
 		/*isDesiredFile*/[&]( const QFileInfo & file ) { return file.suffix().toLower() == selectedEngine->saveFileSuffix(); }
 	);
 
@@ -5039,7 +5502,7 @@ void MainWindow::updateSaveFilesFromDir()
 	}
 }
 
-void MainWindow::updateDemoFilesFromDir()
+void MainWindow::updateDemoFilesFromDir( const DirSnapshotPtr & snapshot )
 {
 	if (!selectedEngine)
 	{
@@ -5050,6 +5513,15 @@ void MainWindow::updateDemoFilesFromDir()
 
 	const QString & demoDir = activeDemoDir;
 
+	if (snapshot && !isSnapshotOf( *snapshot, demoDir, /*recursively*/false ))
+	{
+		return;  // the directory has changed while it was being read
+	}
+
+	demoDirWatcher.setDir( demoDir, /*recursively*/false );
+
+	DirSnapshotPtr dirContent = snapshot ? snapshot : demoDirScanner.scanNow( demoDir, /*recursively*/false, pathConvertor );
+
 	// note down the currently selected item
 	int origReplayDemoIdx = ui->demoFileCmbBox_replay->currentIndex();
 	int origResumeDemoIdx = ui->demoFileCmbBox_resume->currentIndex();
@@ -5058,10 +5530,7 @@ void MainWindow::updateDemoFilesFromDir()
 	// workaround (read the big comment above)
 	disableSelectionCallbacks = true;
 
-	ui->demoFileCmbBox_replay->setCurrentIndex( -1 );
-	ui->demoFileCmbBox_resume->setCurrentIndex( -1 );
-
-	wdg::updateModelFromDir( demoModel, demoDir, /*recursively*/false, /*includeEmptyItem*/false, pathConvertor,
+	wdg::updateModelFromDir( demoModel, *dirContent, /*includeEmptyItem*/false,
 		/*isDesiredFile*/[&]( const QFileInfo & file ) { return file.suffix().toLower() == doom::demoFileSuffix; }
 	);
 
@@ -5120,9 +5589,15 @@ void MainWindow::updateMapNamesFromSelectedFiles()
 		// fill the combox-box
 		if (selectedEngine && selectedEngine->supportsCustomMapNames() && !uniqueMapNames.isEmpty())
 		{
-			auto mapNames = uniqueMapNames;
-			ui->mapCmbBox->addItems( mapNames );
-			ui->mapCmbBox_demo->addItems( mapNames );
+			// The item text must stay the map name, because that's what is passed to the engine,
+			// the titles are cached together with the map names, so they are shown as tool-tips for free.
+			for (auto iter = uniqueMapNames.begin(); iter != uniqueMapNames.end(); ++iter)
+			{
+				ui->mapCmbBox->addItem( iter.key() );
+				ui->mapCmbBox->setItemData( ui->mapCmbBox->count() - 1, iter.value(), Qt::ToolTipRole );
+				ui->mapCmbBox_demo->addItem( iter.key() );
+				ui->mapCmbBox_demo->setItemData( ui->mapCmbBox_demo->count() - 1, iter.value(), Qt::ToolTipRole );
+			}
 		}
 		else  // if we haven't found any map names in the WADs, fallback to the standard names based on IWAD name
 		{
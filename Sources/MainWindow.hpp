@@ -19,13 +19,17 @@
 #include "UserData.hpp"
 #include "UpdateChecker.hpp"
 #include "Themes.hpp"  // SystemThemeWatcher
+#include "Utils/DirWatcher.hpp"
+#include "Utils/DirScanner.hpp"
 class JsonDocumentCtx;
 struct OptionsToLoad;
 
 #include <QMainWindow>
 #include <QString>
+#include <QMap>
 #include <QFileInfo>
 #include <QFileSystemModel>
+#include <QElapsedTimer>
 class QTableWidget;
 class QItemSelection;
 class QComboBox;
@@ -33,6 +37,7 @@ class QLineEdit;
 class QShortcut;
 
 #include <memory>
+#include <future>
 
 namespace Ui
 {
@@ -224,6 +229,15 @@ class MainWindow : public QMainWindow, private DialogWithPaths {
 	bool isCacheDirty() const;
 	bool saveCache( const QString & filePath );
 	bool loadCache( const QString & filePath );
+	bool loadLegacyCache( const QString & filePath );
+	void startCacheLoading();
+	void waitForCacheLoading();
+	void startCacheWarmUp();
+	bool saveCacheChanges( const QString & journalFilePath );
+	bool replayCacheChanges( const QString & journalFilePath );
+	bool shouldCompactCache() const;
+	void startCacheCompaction();
+	bool finishCacheCompaction( bool wait );
 
 	void restoreLoadedOptions( OptionsToLoad && opts );
 	void restorePreset( Preset & preset );
@@ -277,12 +291,13 @@ class MainWindow : public QMainWindow, private DialogWithPaths {
 
 	void updateAlternativePath( QLineEdit * altPathLine );
 
-	void updateListsFromDirs();
-	void updateIWADsFromDir();
+	void pollUnwatchedDirs();
+	void onIWADDirChanged();
+	void updateIWADsFromDir( const DirSnapshotPtr & snapshot = nullptr );
 	void resetMapDirModelAndView();
-	void updateConfigFilesFromDir();
-	void updateSaveFilesFromDir();
-	void updateDemoFilesFromDir();
+	void updateConfigFilesFromDir( const DirSnapshotPtr & snapshot = nullptr );
+	void updateSaveFilesFromDir( const DirSnapshotPtr & snapshot = nullptr );
+	void updateDemoFilesFromDir( const DirSnapshotPtr & snapshot = nullptr );
 	void updateMapNamesFromSelectedFiles();
 	void selectStartingMapFromSelectedFiles();
 	void updateCompatModes();
@@ -354,10 +369,11 @@ class MainWindow : public QMainWindow, private DialogWithPaths {
 
 	static bool canContainMapNames( const QString & filePath );
 	static bool canContainMapNames( const Mod & mod );
+	static void prefetchModsInfo( const Preset & preset );
 	static bool canAnyOfTheFilesContainMapNames( const QStringList & filePaths );
 	static bool canAnyOfTheModsContainMapNames( const QList< IndexValue< Mod > > & mods );
 	static bool canAnyOfTheModsContainMapNames( const PtrList<Mod> & mods, int row, int count );
-	QStringList getUniqueMapNamesFromSelectedFiles() const;
+	QMap< QString, QString > getUniqueMapNamesFromSelectedFiles() const;  ///< map name -> title or empty string
 	int getStartingMapIndexFromSelectedFiles() const;
 
 	LaunchOptions & activeLaunchOptions();
@@ -432,6 +448,12 @@ class MainWindow : public QMainWindow, private DialogWithPaths {
 	QDir appDataDir;   ///< directory where this application can store its data
 	QString optionsFilePath;  ///< path to file with user options
 	QString cacheFilePath;    ///< path to file with various cached file info
+	QString legacyCacheFilePath;  ///< path to the JSON cache file used by older versions, only read once to convert it
+	QString cacheJournalFilePath;  ///< path to file with cache changes made since the cache file was last written whole
+	std::future< QString > cacheCompaction;  ///< rewriting of the cache file in a background thread, returns error message
+	std::future< void > cacheLoading;  ///< loading of the cache file and its journal in a background thread during startup
+
+	QElapsedTimer startupTimer;  ///< measures the time until the window is fully loaded and usable
 
 	struct ConfigFile;
 
@@ -451,6 +473,17 @@ class MainWindow : public QMainWindow, private DialogWithPaths {
 	QString activeDemoDir;         ///< directory where the launcher and engine will search for demo files in the current launcher state, maintains the path style of the engine's data dir
 	QString activeScreenshotDir;   ///< directory where this launcher will search for screenshot files in the current launcher state, maintains the path style of the engine's data dir
 
+	// the lists populated from directories are updated only when the content of their directory changes
+	DirWatcher iwadDirWatcher { u"iwadDir" };       ///< watches iwadSettings.dir when iwadSettings.updateFromDir is enabled
+	DirWatcher configDirWatcher { u"configDir" };   ///< watches activeConfigDir
+	DirWatcher saveDirWatcher { u"saveDir" };       ///< watches activeSaveDir
+	DirWatcher demoDirWatcher { u"demoDir" };       ///< watches activeDemoDir
+	// and the directories are then read in a background thread, so that a slow drive doesn't freeze the GUI
+	DirScanner iwadDirScanner;
+	DirScanner configDirScanner;
+	DirScanner saveDirScanner;
+	DirScanner demoDirScanner;
+
  private: // user data
 
 	// We use model-view design pattern for several widgets, because it allows us to organize the data in a way we need,
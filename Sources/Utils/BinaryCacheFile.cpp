@@ -0,0 +1,502 @@
+//======================================================================================================================
+// Project: DoomRunner
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: compact binary storage of the file info caches
+//======================================================================================================================
+
+#include "BinaryCacheFile.hpp"
+
+#include "HashUtils.hpp"
+#include "CommonTypes.hpp"  // qsize_t
+
+#include <QFile>
+#include <QStringBuilder>
+
+#include <cstring>  // memcpy, memcmp, strnlen
+#include <algorithm>  // min, clamp
+#include <vector>
+
+
+//======================================================================================================================
+// file format
+//
+// [FileHeader]
+// [SectionHeader] x sectionCount
+// for each section:
+//     [RecordHeader][file path in UTF-16][payload]  x recordCount, each aligned to 8 bytes
+//     [Slot] x slotCount  (open-addressing hash table, slotCount is a power of 2)
+//
+// All numbers are stored in the native byte order. A cache written on a machine with a different byte order
+// simply fails the version check and is rebuilt.
+//
+// journal format
+//
+// [JournalHeader]
+// [JournalRecordHeader][file path in UTF-16][payload]  x any number, each aligned to 8 bytes
+
+// Increment this whenever the layout below or the serialization of any cached FileInfo changes.
+static constexpr uint32_t formatVersion = 7;
+
+static constexpr char formatMagic [8] = { 'D', 'R', 'C', 'A', 'C', 'H', 'E', '\0' };
+
+struct FileHeader
+{
+	char magic [8];
+	uint32_t formatVersion;
+	uint32_t sectionCount;
+};
+static_assert( sizeof(FileHeader) == 16 );
+
+struct SectionHeader
+{
+	char name [16];
+	uint64_t slotTableOffset;
+	uint32_t slotCount;
+	uint32_t recordCount;
+};
+static_assert( sizeof(SectionHeader) == 32 );
+
+struct Slot
+{
+	uint64_t pathHash;
+	uint64_t recordOffset;  ///< 0 means empty slot, no record can start at the beginning of the file
+};
+static_assert( sizeof(Slot) == 16 );
+
+struct RecordHeader
+{
+	uint64_t pathHash;
+	int64_t lastModified;
+	int64_t fileSize;
+	uint64_t contentHash;  ///< 0 when unknown
+	uint32_t status;
+	uint32_t pathLength;   ///< in UTF-16 code units
+	uint32_t payloadSize;
+	uint32_t lastUsed;     ///< seconds since epoch, 0 in files written before this was tracked
+};
+static_assert( sizeof(RecordHeader) == 48 );
+
+static constexpr char journalMagic [8] = { 'D', 'R', 'J', 'O', 'U', 'R', 'N', 'L' };
+
+struct JournalHeader
+{
+	char magic [8];
+	uint32_t formatVersion;  ///< the same as the cache file, because the payloads are serialized the same way
+	uint32_t reserved;
+};
+static_assert( sizeof(JournalHeader) == 16 );
+
+struct JournalRecordHeader
+{
+	uint64_t checksum;       ///< FNV-1a of everything after this field up to the end of the payload
+	char sectionName [16];
+	RecordHeader record;
+};
+static_assert( sizeof(JournalRecordHeader) == 72 );
+
+static constexpr qint64 alignTo8( qint64 offset )
+{
+	return (offset + 7) & ~qint64(7);
+}
+
+template< typename Struct >
+static Struct readStruct( const uchar * src )
+{
+	Struct dest;
+	memcpy( &dest, src, sizeof(Struct) );
+	return dest;
+}
+
+
+//======================================================================================================================
+// reading
+
+std::shared_ptr< BinaryCacheFile > BinaryCacheFile::open( const QString & filePath )
+{
+	auto cacheFile = std::make_shared< BinaryCacheFile >();
+	if (!cacheFile->load( filePath ))
+		return nullptr;
+	return cacheFile;
+}
+
+bool BinaryCacheFile::load( const QString & filePath )
+{
+	ReadStatus openStatus = _file.open( filePath );
+	if (openStatus != ReadStatus::Success)
+	{
+		logRuntimeError() << "cannot open "<<filePath<<": "<<_file.errorString();
+		return false;
+	}
+
+	const uchar * headerData = _file.dataAt( 0, sizeof(FileHeader) );
+	if (!headerData)
+	{
+		logRuntimeError() << filePath << " is smaller than the file header";
+		return false;
+	}
+	auto fileHeader = readStruct< FileHeader >( headerData );
+	if (memcmp( fileHeader.magic, formatMagic, sizeof(formatMagic) ) != 0)
+	{
+		logRuntimeError() << filePath << " is not a file-info cache";
+		return false;
+	}
+	if (fileHeader.formatVersion != formatVersion)
+	{
+		logInfo() << filePath << " was written by a different version ("<<fileHeader.formatVersion<<"), it will be rebuilt";
+		return false;
+	}
+
+	const uchar * sectionHeaders = _file.dataAt( sizeof(FileHeader), qint64( fileHeader.sectionCount ) * sizeof(SectionHeader) );
+	if (!sectionHeaders)
+	{
+		logRuntimeError() << filePath << ": section headers point beyond the end of file";
+		return false;
+	}
+
+	_sections.reserve( fileHeader.sectionCount );
+	for (uint32_t i = 0; i < fileHeader.sectionCount; ++i)
+	{
+		auto sectionHeader = readStruct< SectionHeader >( sectionHeaders + i * sizeof(SectionHeader) );
+
+		bool isPowerOf2 = sectionHeader.slotCount != 0 && (sectionHeader.slotCount & (sectionHeader.slotCount - 1)) == 0;
+		if (!isPowerOf2 || sectionHeader.recordCount >= sectionHeader.slotCount
+		 || !_file.containsRange( qint64( sectionHeader.slotTableOffset ), qint64( sectionHeader.slotCount ) * sizeof(Slot) ))
+		{
+			logRuntimeError() << filePath << ": section "<<i<<" is corrupted";
+			return false;
+		}
+
+		Section section;
+		section.name = QString::fromLatin1( sectionHeader.name, int( strnlen( sectionHeader.name, sizeof(sectionHeader.name) ) ) );
+		section.slotTableOffset = qint64( sectionHeader.slotTableOffset );
+		section.slotCount = sectionHeader.slotCount;
+		section.recordCount = sectionHeader.recordCount;
+		_sections.append( std::move(section) );
+	}
+
+	return true;
+}
+
+int BinaryCacheFile::findSection( QStringView sectionName ) const
+{
+	for (qsize_t i = 0; i < _sections.size(); ++i)
+		if (QStringView( _sections[i].name ) == sectionName)
+			return int(i);
+	return -1;
+}
+
+int BinaryCacheFile::recordCount( int sectionIdx ) const
+{
+	if (sectionIdx < 0 || sectionIdx >= _sections.size())
+		return 0;
+	return int( _sections[ sectionIdx ].recordCount );
+}
+
+bool BinaryCacheFile::readRecord( qint64 recordOffset, BinaryCacheRecord & record ) const
+{
+	const uchar * headerData = _file.dataAt( recordOffset, sizeof(RecordHeader) );
+	if (!headerData)
+		return false;
+	auto recordHeader = readStruct< RecordHeader >( headerData );
+
+	qint64 pathOffset = recordOffset + qint64( sizeof(RecordHeader) );
+	qint64 pathSize = qint64( recordHeader.pathLength ) * qint64( sizeof(QChar) );
+	qint64 payloadOffset = pathOffset + pathSize;
+	const uchar * pathData = _file.dataAt( pathOffset, pathSize );
+	const uchar * payloadData = _file.dataAt( payloadOffset, recordHeader.payloadSize );
+	if (!pathData || !payloadData)
+		return false;
+
+	// records are aligned to 8 bytes, so the path is properly aligned for QChar
+	record.filePath = QStringView( reinterpret_cast< const QChar * >( pathData ), qsize_t( recordHeader.pathLength ) );
+	record.lastModified = recordHeader.lastModified;
+	record.fileSize = recordHeader.fileSize;
+	record.contentHash = recordHeader.contentHash;
+	record.lastUsed = recordHeader.lastUsed;
+	record.status = ReadStatus( recordHeader.status );
+	record.payload = QByteArray::fromRawData( reinterpret_cast< const char * >( payloadData ), qsize_t( recordHeader.payloadSize ) );
+	return true;
+}
+
+bool BinaryCacheFile::findRecord( int sectionIdx, const QString & filePath, BinaryCacheRecord & record ) const
+{
+	if (sectionIdx < 0 || sectionIdx >= _sections.size())
+		return false;
+	const Section & section = _sections[ sectionIdx ];
+
+	const uchar * slotTable = _file.data() + section.slotTableOffset;
+	const uint64_t pathHash = hashFilePath( filePath );
+	const uint32_t mask = section.slotCount - 1;
+
+	// linear probing, the table is at most half full, so this usually ends after the first or second slot
+	for (uint32_t probe = 0, slotIdx = uint32_t( pathHash ) & mask; probe < section.slotCount; ++probe, slotIdx = (slotIdx + 1) & mask)
+	{
+		auto slot = readStruct< Slot >( slotTable + slotIdx * sizeof(Slot) );
+		if (slot.recordOffset == 0)
+			return false;  // empty slot terminates the chain
+		if (slot.pathHash != pathHash)
+			continue;
+		if (!readRecord( qint64( slot.recordOffset ), record ))
+		{
+			logRuntimeError() << "record of "<<filePath<<" points beyond the end of "<<_file.fileName();
+			return false;
+		}
+		if (record.filePath == QStringView( filePath ))  // in case of a hash collision
+			return true;
+	}
+
+	return false;
+}
+
+void BinaryCacheFile::forEachRecord( int sectionIdx, const std::function< void ( const BinaryCacheRecord & record ) > & loopBody ) const
+{
+	if (sectionIdx < 0 || sectionIdx >= _sections.size())
+		return;
+	const Section & section = _sections[ sectionIdx ];
+
+	const uchar * slotTable = _file.data() + section.slotTableOffset;
+	for (uint32_t slotIdx = 0; slotIdx < section.slotCount; ++slotIdx)
+	{
+		auto slot = readStruct< Slot >( slotTable + slotIdx * sizeof(Slot) );
+		if (slot.recordOffset == 0)
+			continue;
+		BinaryCacheRecord record;
+		if (readRecord( qint64( slot.recordOffset ), record ))
+			loopBody( record );
+	}
+}
+
+
+//======================================================================================================================
+// writing
+
+void BinaryCacheWriter::beginSection( const QString & sectionName )
+{
+	_sections.append({ sectionName, {} });
+}
+
+void BinaryCacheWriter::addRecord(
+	const QString & filePath, qint64 lastModified, qint64 fileSize, uint64_t contentHash, qint64 lastUsed,
+	ReadStatus status, QByteArray payload
+){
+	if (_sections.isEmpty())
+		beginSection( {} );
+	_sections.last().records.append({ filePath, lastModified, fileSize, contentHash, lastUsed, status, std::move(payload) });
+}
+
+template< typename Struct >
+static void appendStruct( QByteArray & dest, const Struct & src )
+{
+	dest.append( reinterpret_cast< const char * >( &src ), qsize_t( sizeof(Struct) ) );
+}
+
+static void padTo8( QByteArray & dest )
+{
+	dest.append( qsize_t( alignTo8( dest.size() ) - dest.size() ), '\0' );
+}
+
+QByteArray BinaryCacheWriter::finish() const
+{
+	QByteArray content;
+
+	FileHeader fileHeader;
+	memcpy( fileHeader.magic, formatMagic, sizeof(formatMagic) );
+	fileHeader.formatVersion = formatVersion;
+	fileHeader.sectionCount = uint32_t( _sections.size() );
+	appendStruct( content, fileHeader );
+
+	// reserve space for the section headers, they will be filled when the offsets are known
+	const qsize_t sectionHeadersOffset = content.size();
+	content.append( qsize_t( _sections.size() * sizeof(SectionHeader) ), '\0' );
+
+	for (qsize_t sectionIdx = 0; sectionIdx < _sections.size(); ++sectionIdx)
+	{
+		const Section & section = _sections[ sectionIdx ];
+
+		// keep the table at most half full, so that the probing sequences stay short
+		uint32_t slotCount = 8;
+		while (slotCount < 2 * uint32_t( section.records.size() ) + 1)
+			slotCount *= 2;
+		std::vector< Slot > slots( slotCount, Slot{ 0, 0 } );
+
+		for (const Record & record : section.records)
+		{
+			padTo8( content );
+			const qint64 recordOffset = content.size();
+
+			RecordHeader recordHeader;
+			recordHeader.pathHash = hashFilePath( record.filePath );
+			recordHeader.lastModified = record.lastModified;
+			recordHeader.fileSize = record.fileSize;
+			recordHeader.contentHash = record.contentHash;
+			recordHeader.status = uint32_t( record.status );
+			recordHeader.pathLength = uint32_t( record.filePath.size() );
+			recordHeader.payloadSize = uint32_t( record.payload.size() );
+			recordHeader.lastUsed = uint32_t( std::clamp( record.lastUsed, qint64(0), qint64( UINT32_MAX ) ) );
+			appendStruct( content, recordHeader );
+			content.append( reinterpret_cast< const char * >( record.filePath.constData() ), record.filePath.size() * qsize_t( sizeof(QChar) ) );
+			content.append( record.payload );
+
+			uint32_t slotIdx = uint32_t( recordHeader.pathHash ) & (slotCount - 1);
+			while (slots[ slotIdx ].recordOffset != 0)
+				slotIdx = (slotIdx + 1) & (slotCount - 1);
+			slots[ slotIdx ] = { recordHeader.pathHash, uint64_t( recordOffset ) };
+		}
+
+		padTo8( content );
+		const qint64 slotTableOffset = content.size();
+		content.append( reinterpret_cast< const char * >( slots.data() ), qsize_t( slots.size() * sizeof(Slot) ) );
+
+		SectionHeader sectionHeader;
+		memset( sectionHeader.name, 0, sizeof(sectionHeader.name) );
+		QByteArray sectionName = section.name.toLatin1();
+		memcpy( sectionHeader.name, sectionName.constData(), std::min( size_t( sectionName.size() ), sizeof(sectionHeader.name) ) );
+		sectionHeader.slotTableOffset = uint64_t( slotTableOffset );
+		sectionHeader.slotCount = slotCount;
+		sectionHeader.recordCount = uint32_t( section.records.size() );
+		memcpy( content.data() + sectionHeadersOffset + sectionIdx * qsize_t( sizeof(SectionHeader) ), &sectionHeader, sizeof(sectionHeader) );
+	}
+
+	return content;
+}
+
+
+//======================================================================================================================
+// journal
+
+static void copySectionName( char (& dest) [16], const QString & sectionName )
+{
+	memset( dest, 0, sizeof(dest) );
+	QByteArray nameBytes = sectionName.toLatin1();
+	memcpy( dest, nameBytes.constData(), std::min( size_t( nameBytes.size() ), sizeof(dest) ) );
+}
+
+void BinaryCacheJournalWriter::addRecord(
+	const QString & filePath, qint64 lastModified, qint64 fileSize, uint64_t contentHash, qint64 lastUsed,
+	ReadStatus status, const QByteArray & payload
+){
+	JournalRecordHeader recordHeader;
+	copySectionName( recordHeader.sectionName, _currentSection );
+	recordHeader.record.pathHash = hashFilePath( filePath );
+	recordHeader.record.lastModified = lastModified;
+	recordHeader.record.fileSize = fileSize;
+	recordHeader.record.contentHash = contentHash;
+	recordHeader.record.status = uint32_t( status );
+	recordHeader.record.pathLength = uint32_t( filePath.size() );
+	recordHeader.record.payloadSize = uint32_t( payload.size() );
+	recordHeader.record.lastUsed = uint32_t( std::clamp( lastUsed, qint64(0), qint64( UINT32_MAX ) ) );
+	recordHeader.checksum = 0;
+
+	const qsize_t recordOffset = _content.size();
+	appendStruct( _content, recordHeader );
+	_content.append( reinterpret_cast< const char * >( filePath.constData() ), filePath.size() * qsize_t( sizeof(QChar) ) );
+	_content.append( payload );
+
+	const qsize_t checkedOffset = recordOffset + qsize_t( sizeof(recordHeader.checksum) );
+	uint64_t checksum = fnv1a64( _content.constData() + checkedOffset, size_t( _content.size() - checkedOffset ) );
+	memcpy( _content.data() + recordOffset, &checksum, sizeof(checksum) );
+
+	padTo8( _content );
+	_recordCount++;
+}
+
+QString BinaryCacheJournalWriter::appendTo( const QString & journalFilePath ) const
+{
+	QFile file( journalFilePath );
+	if (!file.open( QIODevice::ReadWrite ))
+	{
+		return "Could not open "%journalFilePath%" for writing: "%file.errorString();
+	}
+
+	QByteArray data;
+	if (file.size() == 0)
+	{
+		JournalHeader journalHeader;
+		memcpy( journalHeader.magic, journalMagic, sizeof(journalMagic) );
+		journalHeader.formatVersion = formatVersion;
+		journalHeader.reserved = 0;
+		appendStruct( data, journalHeader );
+	}
+	data.append( _content );
+
+	// the records must stay aligned, even if the previous write was interrupted
+	if (!file.seek( alignTo8( file.size() ) ) || file.write( data ) != data.size() || !file.flush())
+	{
+		return "Could not write to "%journalFilePath%": "%file.errorString();
+	}
+
+	return {};
+}
+
+bool replayBinaryCacheJournal(
+	const QString & journalFilePath,
+	const std::function< void ( QStringView sectionName, const BinaryCacheRecord & record ) > & loopBody
+){
+	QFile file( journalFilePath );
+	if (!file.open( QIODevice::ReadWrite ))
+	{
+		logRuntimeError( u"BinaryCacheJournal" ) << "cannot open "<<journalFilePath<<": "<<file.errorString();
+		return false;
+	}
+
+	// the journal is kept small by regular compaction, so it can be simply read whole
+	const QByteArray content = file.readAll();
+	const uchar * data = reinterpret_cast< const uchar * >( content.constData() );
+	const qint64 size = content.size();
+
+	if (size < qint64( sizeof(JournalHeader) ))
+	{
+		return true;  // empty or was interrupted before anything useful was written
+	}
+	auto journalHeader = readStruct< JournalHeader >( data );
+	if (memcmp( journalHeader.magic, journalMagic, sizeof(journalMagic) ) != 0 || journalHeader.formatVersion != formatVersion)
+	{
+		logInfo( u"BinaryCacheJournal" ) << journalFilePath << " is not compatible with this version, discarding it";
+		file.close();
+		file.remove();
+		return false;
+	}
+
+	qint64 offset = sizeof(JournalHeader);
+	while (offset < size)
+	{
+		if (size - offset < qint64( sizeof(JournalRecordHeader) ))
+			break;
+		auto recordHeader = readStruct< JournalRecordHeader >( data + offset );
+
+		const qint64 pathOffset = offset + qint64( sizeof(JournalRecordHeader) );
+		const qint64 pathSize = qint64( recordHeader.record.pathLength ) * qint64( sizeof(QChar) );
+		const qint64 recordEnd = pathOffset + pathSize + qint64( recordHeader.record.payloadSize );
+		if (recordEnd > size)
+			break;
+		const qint64 checkedOffset = offset + qint64( sizeof(recordHeader.checksum) );
+		if (fnv1a64( data + checkedOffset, size_t( recordEnd - checkedOffset ) ) != recordHeader.checksum)
+			break;
+
+		// the records are aligned to 8 bytes, so the path is properly aligned for QChar
+		BinaryCacheRecord record;
+		record.filePath = QStringView( reinterpret_cast< const QChar * >( data + pathOffset ), qsize_t( recordHeader.record.pathLength ) );
+		record.lastModified = recordHeader.record.lastModified;
+		record.fileSize = recordHeader.record.fileSize;
+		record.contentHash = recordHeader.record.contentHash;
+		record.lastUsed = recordHeader.record.lastUsed;
+		record.status = ReadStatus( recordHeader.record.status );
+		record.payload = QByteArray::fromRawData( content.constData() + pathOffset + pathSize, qsize_t( recordHeader.record.payloadSize ) );
+
+		QString sectionName = QString::fromLatin1(
+			recordHeader.sectionName, int( strnlen( recordHeader.sectionName, sizeof(recordHeader.sectionName) ) )
+		);
+		loopBody( sectionName, record );
+
+		offset = alignTo8( recordEnd );
+	}
+
+	if (offset < size)
+	{
+		logRuntimeError( u"BinaryCacheJournal" ) << journalFilePath << " has an incomplete record at "<<offset<<", cutting it off";
+		file.resize( offset );
+	}
+
+	return true;
+}
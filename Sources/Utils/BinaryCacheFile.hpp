@@ -0,0 +1,180 @@
+//======================================================================================================================
+// Project: DoomRunner
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: compact binary storage of the file info caches
+//======================================================================================================================
+
+#ifndef BINARY_CACHE_FILE_INCLUDED
+#define BINARY_CACHE_FILE_INCLUDED
+
+
+#include "Essential.hpp"
+
+#include "FileInfoCacheTypes.hpp"  // ReadStatus
+#include "MappedFile.hpp"
+#include "ErrorHandling.hpp"  // LoggingComponent
+
+#include <QString>
+#include <QStringView>
+#include <QByteArray>
+#include <QList>
+#include <QDataStream>
+
+#include <memory>
+#include <functional>
+
+
+/// Version of QDataStream used to serialize the FileInfo structures into the binary cache.
+/** Fixed, so that the same cache file can be read by both Qt5 and Qt6 builds. */
+inline constexpr int binaryCacheStreamVersion = QDataStream::Qt_5_15;
+
+
+//======================================================================================================================
+/// One record of the binary cache file, represents one cache entry.
+
+struct BinaryCacheRecord
+{
+	QStringView filePath;   ///< when reading, points directly into the mapped file
+	qint64 lastModified;    ///< seconds since epoch
+	qint64 fileSize;
+	uint64_t contentHash;   ///< fingerprint of the file content, 0 when unknown
+	qint64 lastUsed;        ///< seconds since epoch when the entry was last requested, 0 when unknown
+	ReadStatus status;
+	QByteArray payload;     ///< serialized FileInfo, when reading, points directly into the mapped file
+};
+
+
+//======================================================================================================================
+/// Read-only view of the binary cache file mapped into memory.
+/** The file consists of named sections, one for each cache (exe_info, wad_info, ...).
+  * Each section has an open-addressing hash table indexed by a stable hash of the file path,
+  * so any entry can be found in O(1) without parsing the rest of the file.
+  * The entries are deserialized only when they are actually requested. */
+
+class BinaryCacheFile : protected LoggingComponent {
+
+	struct Section
+	{
+		QString name;
+		qint64 slotTableOffset;
+		uint32_t slotCount;
+		uint32_t recordCount;
+	};
+
+	fs::MappedFile _file;
+	QList< Section > _sections;
+
+ public:
+
+	BinaryCacheFile() : LoggingComponent( u"BinaryCacheFile" ) {}
+
+	/// Maps the file into memory and validates its header.
+	/** Returns nullptr when the file doesn't exist, is corrupted or was written by an incompatible version. */
+	static std::shared_ptr< BinaryCacheFile > open( const QString & filePath );
+
+	QString filePath() const  { return _file.fileName(); }
+
+	/// Returns index of a section with this name or -1 if there is no such section.
+	int findSection( QStringView sectionName ) const;
+
+	/// Number of records in a section.
+	int recordCount( int sectionIdx ) const;
+
+	/// Finds a record of a particular file in O(1) time.
+	/** The returned record points into the mapped memory and is valid only as long as this object exists. */
+	bool findRecord( int sectionIdx, const QString & filePath, BinaryCacheRecord & record ) const;
+
+	/// Calls the loopBody for every record in a section.
+	void forEachRecord( int sectionIdx, const std::function< void ( const BinaryCacheRecord & record ) > & loopBody ) const;
+
+ private:
+
+	bool load( const QString & filePath );
+
+	bool readRecord( qint64 recordOffset, BinaryCacheRecord & record ) const;
+
+};
+
+
+//======================================================================================================================
+/// Builds content of a new binary cache file.
+
+class BinaryCacheWriter {
+
+	struct Record
+	{
+		QString filePath;
+		qint64 lastModified;
+		qint64 fileSize;
+		uint64_t contentHash;
+		qint64 lastUsed;
+		ReadStatus status;
+		QByteArray payload;
+	};
+
+	struct Section
+	{
+		QString name;
+		QList< Record > records;
+	};
+
+	QList< Section > _sections;
+
+ public:
+
+	/// All the following records will belong to a section with this name.
+	void beginSection( const QString & sectionName );
+
+	void addRecord(
+		const QString & filePath, qint64 lastModified, qint64 fileSize, uint64_t contentHash, qint64 lastUsed,
+		ReadStatus status, QByteArray payload
+	);
+
+	/// Lays out all the sections and returns the complete file content.
+	QByteArray finish() const;
+
+};
+
+
+//======================================================================================================================
+/// Collects new or changed entries to be appended to the journal of the binary cache file.
+/** The journal allows saving the changes without rewriting the whole cache file, the cost of each save is
+  * proportional to the number of changes. Once the journal grows too big, the cache file should be rewritten
+  * with all the entries and the journal deleted. */
+
+class BinaryCacheJournalWriter {
+
+	QString _currentSection;
+	QByteArray _content;
+	int _recordCount = 0;
+
+ public:
+
+	/// All the following records will belong to a section with this name.
+	void beginSection( const QString & sectionName )  { _currentSection = sectionName; }
+
+	void addRecord(
+		const QString & filePath, qint64 lastModified, qint64 fileSize, uint64_t contentHash, qint64 lastUsed,
+		ReadStatus status, const QByteArray & payload
+	);
+
+	int recordCount() const  { return _recordCount; }
+
+	/// Appends the collected records to the journal file, creates the file if it doesn't exist.
+	/** Returns an error message or empty string on success. */
+	QString appendTo( const QString & journalFilePath ) const;
+
+};
+
+/// Reads all the valid records of a journal in the order they were appended.
+/** A record that was written only partially (for example the application crashed in the middle of writing)
+  * and everything after it is cut off from the file, so that the records appended later can be read again.
+  * A journal of an incompatible version is deleted. Returns false if the journal could not be read. */
+bool replayBinaryCacheJournal(
+	const QString & journalFilePath,
+	const std::function< void ( QStringView sectionName, const BinaryCacheRecord & record ) > & loopBody
+);
+
+
+#endif // BINARY_CACHE_FILE_INCLUDED
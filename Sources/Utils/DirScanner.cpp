@@ -0,0 +1,118 @@
+//======================================================================================================================
+// Project: DoomRunner
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: listing of directory content in a background thread
+//======================================================================================================================
+
+#include "DirScanner.hpp"
+
+#include "FileSystemUtils.hpp"  // traverseDirectory, traverseDirectoryInParallel, PathConvertor
+#include "ThreadUtils.hpp"      // dirScanThreadPool
+
+#include <QThreadPool>
+
+
+DirSnapshotPtr takeDirSnapshot(
+	const QString & dir, bool recursively, const PathConvertor & pathConvertor, const std::atomic< bool > * cancelled
+){
+	auto snapshot = std::make_shared< DirSnapshot >();
+	snapshot->dir = dir;
+	snapshot->recursively = recursively;
+
+	auto addEntry = [&]( const QFileInfo & entry, bool isDir )
+	{
+		if (isDir)
+			snapshot->subdirs.append( entry.filePath() );
+		else
+			snapshot->files.append( entry );
+	};
+
+	bool finished;
+	if (recursively)
+	{
+		// The tree can be large enough to be worth listing by multiple threads. They are taken from the pool
+		// of the directory scans, so that a stuck network drive doesn't block the threads of the other pools.
+		finished = fs::traverseDirectoryInParallel(
+			dir, recursively, fs::EntryType::FILE | fs::EntryType::DIR, pathConvertor, addEntry, cancelled, &dirScanThreadPool()
+		);
+	}
+	else
+	{
+		finished = fs::traverseDirectory( dir, recursively, fs::EntryType::FILE, pathConvertor, addEntry, cancelled );
+	}
+
+	if (!finished)
+		return nullptr;
+
+	return snapshot;
+}
+
+
+DirScanner::DirScanner()
+:
+	// The relay must be deleted in its own thread, but the last reference might be released by a background thread.
+	_relay( new impl::DirScanRelay, []( impl::DirScanRelay * relay ) { relay->deleteLater(); } )
+{
+	connect( _relay.get(), &impl::DirScanRelay::scanFinished, this, &DirScanner::onScanFinished );
+}
+
+DirScanner::~DirScanner()
+{
+	// the scan can't be waited for, it might be stuck on an unresponsive network drive
+	cancel();
+}
+
+void DirScanner::cancel()
+{
+	if (_cancelFlag)
+	{
+		_cancelFlag->store( true, std::memory_order_relaxed );
+		_cancelFlag.reset();
+	}
+	_lastScanID++;  // in case the scan has already finished and its result is waiting in the event queue
+}
+
+void DirScanner::startScan( const QString & dir, bool recursively, const PathConvertor & pathConvertor )
+{
+	cancel();
+
+	auto cancelFlag = std::make_shared< std::atomic< bool > >( false );
+	_cancelFlag = cancelFlag;
+	quint64 scanID = _lastScanID;
+
+	dirScanThreadPool().start(
+		[ relay = _relay, cancelFlag, scanID, dir, recursively, pathConvertor ]()
+		{
+			DirSnapshotPtr snapshot = takeDirSnapshot( dir, recursively, pathConvertor, cancelFlag.get() );
+			if (!snapshot)
+				return;
+
+			// the connected DirScanner lives in the same thread as the relay, so this will be executed in that thread
+			QMetaObject::invokeMethod( relay.get(), [ relay, scanID, snapshot ]()
+			{
+				emit relay->scanFinished( scanID, snapshot );
+			}, Qt::QueuedConnection );
+		},
+		taskPriority::Normal
+	);
+}
+
+DirSnapshotPtr DirScanner::scanNow( const QString & dir, bool recursively, const PathConvertor & pathConvertor )
+{
+	cancel();
+
+	return takeDirSnapshot( dir, recursively, pathConvertor );
+}
+
+void DirScanner::onScanFinished( quint64 scanID, const DirSnapshotPtr & snapshot )
+{
+	if (scanID != _lastScanID)
+	{
+		return;  // superseded by a newer scan or by scanNow()
+	}
+
+	_cancelFlag.reset();
+
+	emit snapshotReady( snapshot );
+}
@@ -0,0 +1,104 @@
+//======================================================================================================================
+// Project: DoomRunner
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: listing of directory content in a background thread
+//======================================================================================================================
+
+#ifndef DIR_SCANNER_INCLUDED
+#define DIR_SCANNER_INCLUDED
+
+
+#include "Essential.hpp"
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QFileInfo>
+
+#include <memory>
+#include <atomic>
+
+class PathConvertor;
+
+
+//======================================================================================================================
+/// Files found in a directory at one point in time.
+/** It's never modified after it's created, so it can be freely shared between threads. */
+
+struct DirSnapshot
+{
+	QString dir;
+	bool recursively = false;
+	QList< QFileInfo > files;  ///< in the order of traversal, the paths are already converted by the PathConvertor
+	QStringList subdirs;       ///< all the subdirectories in the tree, only when listed recursively, needed for watching it
+};
+
+using DirSnapshotPtr = std::shared_ptr< const DirSnapshot >;
+
+/// Lists the files in a directory in the calling thread. Returns nullptr if the listing was cancelled.
+DirSnapshotPtr takeDirSnapshot(
+	const QString & dir, bool recursively, const PathConvertor & pathConvertor, const std::atomic< bool > * cancelled = nullptr
+);
+
+
+namespace impl {
+
+/// Delivers the results of the background scans to the thread of the DirScanner.
+/** It's co-owned by the running scans, so that a scan that finishes after the DirScanner is destroyed
+  * still has a valid object to post its result to. */
+class DirScanRelay : public QObject {
+
+	Q_OBJECT
+
+ signals:
+
+	void scanFinished( quint64 scanID, const DirSnapshotPtr & snapshot );
+
+};
+
+} // namespace impl
+
+
+//======================================================================================================================
+/// Lists the files in a directory in a background thread, so that a slow disk or network drive doesn't freeze the GUI.
+/** Only the result of the latest scan is delivered, starting a new scan cancels the previous one. */
+
+class DirScanner : public QObject {
+
+	Q_OBJECT
+
+ public:
+
+	DirScanner();
+	virtual ~DirScanner() override;
+
+	/// Starts listing the files in a background thread. The result is delivered by snapshotReady() signal
+	/// in the thread that owns this object. A scan that is still running is cancelled.
+	void startScan( const QString & dir, bool recursively, const PathConvertor & pathConvertor );
+
+	/// Lists the files immediately in the calling thread. A scan that is still running is cancelled.
+	/** For cases where the result is needed right away, for example to restore a selection in the list. */
+	DirSnapshotPtr scanNow( const QString & dir, bool recursively, const PathConvertor & pathConvertor );
+
+	/// Cancels the running scan, its result will not be delivered.
+	void cancel();
+
+ signals:
+
+	/// Emitted when the latest scan finishes.
+	void snapshotReady( const DirSnapshotPtr & snapshot );
+
+ private:
+
+	void onScanFinished( quint64 scanID, const DirSnapshotPtr & snapshot );
+
+	std::shared_ptr< impl::DirScanRelay > _relay;
+	std::shared_ptr< std::atomic< bool > > _cancelFlag;  ///< flag of the running scan, null when there is none
+	quint64 _lastScanID = 0;
+
+};
+
+
+#endif // DIR_SCANNER_INCLUDED
@@ -0,0 +1,147 @@
+//======================================================================================================================
+// Project: DoomRunner
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: notifications about changes of directory content
+//======================================================================================================================
+
+#include "DirWatcher.hpp"
+
+#include <QSet>
+
+
+/// How long to wait after the first change before emitting the signal, so that the following changes are included.
+static constexpr int settleDelay_ms = 500;
+
+/// How often to emit the signal even when the directory is watched, because the notifications from network drives
+/// (NFS, SMB) don't include the changes made by other machines.
+static constexpr qint64 rescanInterval_ms = 30 * 1000;
+
+
+DirWatcher::DirWatcher( QStringView name )
+:
+	LoggingComponent( u"DirWatcher", name )
+{
+	_settleTimer.setSingleShot( true );
+	_settleTimer.setInterval( settleDelay_ms );
+	_sinceLastUpdate.start();
+
+	connect( &_watcher, &QFileSystemWatcher::directoryChanged, this, &DirWatcher::onDirectoryChanged );
+	connect( &_settleTimer, &QTimer::timeout, this, &DirWatcher::onChangesSettled );
+}
+
+void DirWatcher::setDir( const QString & dir, bool recursively )
+{
+	if (dir == _dir && recursively == _recursively)
+	{
+		return;
+	}
+
+	unwatchAll();
+	_settleTimer.stop();
+	_sinceLastUpdate.restart();
+
+	_dir = dir;
+	_recursively = recursively;
+	_subdirs.clear();
+
+	if (!_dir.isEmpty())
+	{
+		watchDirTree();
+	}
+}
+
+void DirWatcher::setSubdirs( const QStringList & subdirs )
+{
+	if (_dir.isEmpty() || !_recursively)
+	{
+		return;
+	}
+
+	_subdirs = subdirs;
+
+	watchDirTree();
+}
+
+void DirWatcher::unwatchAll()
+{
+	const QStringList watchedDirs = _watcher.directories();
+	if (!watchedDirs.isEmpty())
+		_watcher.removePaths( watchedDirs );
+
+	_needsPolling = false;
+}
+
+void DirWatcher::watchDirTree()
+{
+	QSet< QString > watchedDirs;
+	const QStringList watchedDirList = _watcher.directories();
+	watchedDirs.reserve( watchedDirList.size() );
+	for (const QString & dir : watchedDirList)
+		watchedDirs.insert( dir );
+
+	// add only the new subdirectories, the removed ones are dropped by the QFileSystemWatcher automatically
+	QStringList dirsToAdd;
+	if (!watchedDirs.contains( _dir ))
+		dirsToAdd.append( _dir );
+	for (const QString & dir : _subdirs)
+		if (!watchedDirs.contains( dir ))
+			dirsToAdd.append( dir );
+
+	if (!dirsToAdd.isEmpty())
+	{
+		const QStringList failedDirs = _watcher.addPaths( dirsToAdd );
+		if (!failedDirs.isEmpty())
+		{
+			logDebug() << "cannot watch "<<failedDirs.size()<<" directories (first: "<<failedDirs.first()<<"), falling back to polling";
+		}
+		_needsPolling = !failedDirs.isEmpty();
+	}
+	else
+	{
+		_needsPolling = false;
+	}
+}
+
+void DirWatcher::notifyDirChanged()
+{
+	_sinceLastUpdate.restart();
+
+	emit dirChanged();
+}
+
+void DirWatcher::onDirectoryChanged( const QString & /*path*/ )
+{
+	// Don't restart the timer when it's already running, otherwise a continuous stream of changes
+	// would postpone the update indefinitely.
+	if (!_settleTimer.isActive())
+		_settleTimer.start();
+}
+
+void DirWatcher::onChangesSettled()
+{
+	// The directory itself might have been deleted and re-created.
+	// The new subdirectories are added when the owner lists the directory again and calls setSubdirs().
+	if (!_watcher.directories().contains( _dir ))
+		watchDirTree();
+
+	notifyDirChanged();
+}
+
+void DirWatcher::poll()
+{
+	if (_dir.isEmpty())
+	{
+		return;
+	}
+
+	if (_needsPolling)
+	{
+		watchDirTree();
+		notifyDirChanged();
+	}
+	else if (_sinceLastUpdate.hasExpired( rescanInterval_ms ))
+	{
+		notifyDirChanged();
+	}
+}
@@ -0,0 +1,95 @@
+//======================================================================================================================
+// Project: DoomRunner
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: notifications about changes of directory content
+//======================================================================================================================
+
+#ifndef DIR_WATCHER_INCLUDED
+#define DIR_WATCHER_INCLUDED
+
+
+#include "Essential.hpp"
+
+#include "ErrorHandling.hpp"  // LoggingComponent
+
+#include <QObject>
+#include <QFileSystemWatcher>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QString>
+#include <QStringList>
+
+
+//======================================================================================================================
+/// Watches a directory and emits a signal when files are added, removed or renamed in it.
+/** Uses the notifications of the operating system (inotify on Linux, ReadDirectoryChangesW on Windows),
+  * so nothing is done while the directory doesn't change.
+  * The changes that come in a quick succession (for example copying many files) are coalesced into a single signal.
+  * When the directory cannot be watched (it doesn't exist or the system limit of watches was reached),
+  * the owner has to call poll() periodically, which falls back to the old behaviour of regular updates.
+  * Network file systems accept the watches, but don't report the changes made by other machines,
+  * so poll() also emits the signal once in a while even when the directory is watched.
+  * The subdirectories of a recursively watched directory are not listed here, the owner provides them
+  * from its own listing of the directory by setSubdirs(). */
+
+class DirWatcher : public QObject, protected LoggingComponent {
+
+	Q_OBJECT
+
+ public:
+
+	/// The name identifies this watcher in the log messages.
+	DirWatcher( QStringView name );
+	virtual ~DirWatcher() override = default;
+
+	/// Starts watching a directory instead of the previous one. Empty dir stops the watching.
+	/** Does nothing when the directory and the mode are the same as before. */
+	void setDir( const QString & dir, bool recursively );
+
+	const QString & dir() const  { return _dir; }
+
+	/// Sets all the subdirectories of the tree that should be watched together with the directory.
+	/** Does nothing when the directory is not watched recursively. Should be called after every listing
+	  * of the directory that follows dirChanged(), so that the new subdirectories are watched too. */
+	void setSubdirs( const QStringList & subdirs );
+
+	/// Whether the directory could not be watched and needs to be checked for changes regularly.
+	bool needsPolling() const  { return _needsPolling; }
+
+	/// Should be called periodically. If the directory could not be watched, it tries to watch it again
+	/// and emits dirChanged(), because we don't know if something changed in the meantime.
+	/// Otherwise it emits dirChanged() only when there was no update for a long time.
+	void poll();
+
+ signals:
+
+	/// Emitted at most once per coalescing interval when the content of the directory has changed.
+	void dirChanged();
+
+ private slots:
+
+	void onDirectoryChanged( const QString & path );
+	void onChangesSettled();
+
+ private:
+
+	/// Synchronizes the watched paths with the directory and its last known subdirectories.
+	void watchDirTree();
+	void unwatchAll();
+
+	void notifyDirChanged();
+
+	QFileSystemWatcher _watcher;
+	QTimer _settleTimer;   ///< delays the signal, so that a burst of changes results in a single update
+	QElapsedTimer _sinceLastUpdate;  ///< time since dirChanged() was last emitted
+
+	QString _dir;
+	QStringList _subdirs;  ///< from the last listing of the directory, only when watching recursively
+	bool _recursively = false;
+	bool _needsPolling = false;
+
+};
+
+
+#endif // DIR_WATCHER_INCLUDED
@@ -9,6 +9,7 @@
 
 #include "FileSystemUtils.hpp"
 #include "FileInfoCache.hpp"
+#include "StringUtils.hpp"  // heapSize
 #include "ErrorHandling.hpp"
 
 #include <QFile>
@@ -25,6 +26,8 @@ const QString fileSuffix = "dmb";
 struct DMBContent
 {
 	QStringList entries;
+
+	qint64 memoryUsage() const  { return heapSize( entries ); }
 };
 
 using UncertainDMBContent = UncertainFileInfo< DMBContent >;
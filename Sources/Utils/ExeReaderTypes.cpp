@@ -8,6 +8,9 @@
 #include "ExeReaderTypes.hpp"
 
 #include "JsonUtils.hpp"
+#include "StringUtils.hpp"  // heapSize
+
+#include <QDataStream>
 
 
 namespace os {
@@ -27,5 +30,22 @@ void ExeVersionInfo::deserialize( const JsonObjectCtx & jsExeInfo )
 	version = Version( jsExeInfo.getString("version") );
 }
 
+void ExeVersionInfo::serialize( QDataStream & stream ) const
+{
+	stream << appName << description;
+	stream << version.major << version.minor << version.patch << version.build;
+}
+
+void ExeVersionInfo::deserialize( QDataStream & stream )
+{
+	stream >> appName >> description;
+	stream >> version.major >> version.minor >> version.patch >> version.build;
+}
+
+qint64 ExeVersionInfo::memoryUsage() const
+{
+	return heapSize( appName ) + heapSize( description );
+}
+
 
 } // namespace os
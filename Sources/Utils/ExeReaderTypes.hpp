@@ -18,6 +18,7 @@
 
 class QJsonObject;
 class JsonObjectCtx;
+class QDataStream;
 
 
 namespace os {
@@ -32,6 +33,12 @@ struct ExeVersionInfo
 
 	void serialize( QJsonObject & jsExeInfo ) const;
 	void deserialize( const JsonObjectCtx & jsExeInfo );
+
+	void serialize( QDataStream & stream ) const;
+	void deserialize( QDataStream & stream );
+
+	/// Approximate number of bytes allocated on the heap, used for the cache size accounting.
+	qint64 memoryUsage() const;
 };
 
 using UncertainExeVersionInfo = UncertainFileInfo< ExeVersionInfo >;
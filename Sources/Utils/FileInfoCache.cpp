@@ -5,4 +5,155 @@
 // Description: templates and common code for application's internal caches
 //======================================================================================================================
 
-//#include "FileInfoCache.hpp"
+#include "FileInfoCache.hpp"
+
+#include "HashUtils.hpp"
+#include "MappedFile.hpp"
+#include "WADFormat.hpp"
+
+#include <QtEndian>
+
+#include <algorithm>  // min, max, find
+#include <iterator>   // begin, end
+#include <cstring>    // memcmp, memcpy
+
+
+//----------------------------------------------------------------------------------------------------------------------
+// content fingerprint
+//
+// The fingerprint must cover everything the file info is derived from, otherwise a different file of the same size
+// would get stale info of another one. So where the format is recognized, its whole directory is hashed instead of
+// fixed-size samples. The file is mapped into memory, so only the pages that are actually hashed are read.
+
+/// Size of the samples from the beginning and the end of files of unrecognized format.
+static constexpr qint64 fingerprintSampleSize = 64 * 1024;
+
+template< typename Int >
+static Int readLE( const uchar * src )
+{
+	return qFromLittleEndian< Int >( src );
+}
+
+/// Hashes the header and the whole lump directory of a WAD and the content of the map-definition lumps,
+/// which covers all the names the WAD info is derived from. Returns 0 when it's not a valid WAD.
+static uint64_t fingerprintWad( const fs::MappedFile & file, uint64_t hash )
+{
+	using namespace doom;
+
+	const uchar * headerData = file.dataAt( 0, sizeof(WadHeader) );
+	if (!headerData || (memcmp( headerData, "IWAD", 4 ) != 0 && memcmp( headerData, "PWAD", 4 ) != 0))
+	{
+		return 0;
+	}
+	WadHeader header;
+	memcpy( &header, headerData, sizeof(header) );
+
+	const qint64 lumpDirSize = qint64( header.numLumps ) * qint64( sizeof(LumpEntry) );
+	const uchar * lumpDir = file.dataAt( header.lumpDirOffset, lumpDirSize );
+	if (!lumpDir)
+	{
+		return 0;
+	}
+
+	hash = fnv1a64( headerData, sizeof(WadHeader), hash );
+	hash = fnv1a64( lumpDir, size_t( lumpDirSize ), hash );
+
+	static constexpr LumpName mapDefLumps [] = {
+		makeLumpName("ZMAPINFO"), makeLumpName("MAPINFO"), makeLumpName("UMAPINFO"), makeLumpName("EMAPINFO")
+	};
+	for (uint32_t i = 0; i < header.numLumps; ++i)
+	{
+		const LumpEntry lump = readLumpEntry( lumpDir, i );
+		if (std::find( std::begin( mapDefLumps ), std::end( mapDefLumps ), packLumpName( lump.name ) ) != std::end( mapDefLumps ))
+		{
+			if (const uchar * lumpData = file.dataAt( lump.dataOffset, lump.size ))
+			{
+				hash = fnv1a64( lumpData, lump.size, hash );
+			}
+		}
+	}
+
+	return hash;
+}
+
+/// Hashes the whole central directory of a zip, which contains CRC-32 of every entry, so it covers the whole content.
+/** Returns 0 when it's not a zip or it's a zip64, which are rare enough to be sampled instead. */
+static uint64_t fingerprintZip( const fs::MappedFile & file, uint64_t hash )
+{
+	static constexpr uint32_t eocdSignature = 0x06054b50;
+	static constexpr qint64 eocdSize = 22;
+	static constexpr qint64 maxCommentSize = 0xFFFF;
+
+	const uchar * data = file.data();
+	const qint64 size = file.size();
+	if (size < eocdSize)
+	{
+		return 0;
+	}
+
+	// the end of central directory record is at the end, followed only by a variable-length comment
+	const uchar * eocd = nullptr;
+	const qint64 lowestPos = std::max( qint64(0), size - eocdSize - maxCommentSize );
+	for (qint64 pos = size - eocdSize; pos >= lowestPos; --pos)
+	{
+		if (readLE< uint32_t >( data + pos ) == eocdSignature && pos + eocdSize + readLE< uint16_t >( data + pos + 20 ) == size)
+		{
+			eocd = data + pos;
+			break;
+		}
+	}
+	if (!eocd)
+	{
+		return 0;
+	}
+
+	const qint64 centralDirSize = readLE< uint32_t >( eocd + 12 );
+	// the central directory is right before the record, this also works for zips with data prepended before them
+	const uchar * centralDir = file.dataAt( (eocd - data) - centralDirSize, centralDirSize );
+	if (!centralDir || readLE< uint16_t >( eocd + 10 ) == 0xFFFF || readLE< uint32_t >( eocd + 12 ) == 0xFFFFFFFF)
+	{
+		return 0;
+	}
+
+	hash = fnv1a64( centralDir, size_t( centralDirSize ), hash );
+	hash = fnv1a64( eocd, size_t( eocdSize ), hash );
+
+	return hash;
+}
+
+/// Hashes the beginning and the end of a file of unknown format.
+static uint64_t fingerprintSamples( const fs::MappedFile & file, uint64_t hash )
+{
+	const qint64 fileSize = file.size();
+
+	qint64 headSize = std::min( fileSize, fingerprintSampleSize );
+	hash = fnv1a64( file.data(), size_t( headSize ), hash );
+
+	if (fileSize > fingerprintSampleSize)
+	{
+		// don't hash the overlapping part twice
+		qint64 tailOffset = std::max( fingerprintSampleSize, fileSize - fingerprintSampleSize );
+		hash = fnv1a64( file.data() + tailOffset, size_t( fileSize - tailOffset ), hash );
+	}
+
+	return hash;
+}
+
+uint64_t fingerprintFileContent( const QString & filePath, qint64 fileSize )
+{
+	fs::MappedFile file;
+	if (fileSize < 0 || file.open( filePath ) != ReadStatus::Success || file.size() != fileSize)
+	{
+		return 0;  // can't be read or was modified in the meantime
+	}
+
+	uint64_t hash = fnv1a64( &fileSize, sizeof(fileSize) );
+
+	uint64_t structureHash = fingerprintWad( file, hash );
+	if (!structureHash)
+		structureHash = fingerprintZip( file, hash );
+	if (!structureHash)
+		structureHash = fingerprintSamples( file, hash );
+
+	return structureHash != 0 ? structureHash : 1;  // 0 is reserved for unknown
+}
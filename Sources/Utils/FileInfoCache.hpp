@@ -15,18 +15,58 @@
 
 #include "JsonUtils.hpp"
 #include "FileSystemUtils.hpp"  // isValidFile
+#include "BinaryCacheFile.hpp"
+#include "ThreadUtils.hpp"  // parallelFor, backgroundThreadPool
+#include "FileStatCache.hpp"
+#include "StringUtils.hpp"  // heapSize
+#include "CommonTypes.hpp"  // qsize_t
 #include "ErrorHandling.hpp"
 
 #include <QString>
+#include <QStringList>
+#include <QList>
 #include <QHash>
-#include <QFileInfo>
+#include <QSet>
 #include <QDateTime>
 #include <QElapsedTimer>
+#include <QDataStream>
+#include <QThreadPool>
+
+#include <memory>
+#include <utility>  // pair
+#include <array>
+#include <vector>
+#include <optional>
+#include <future>
+#include <mutex>
+#include <atomic>
+#include <algorithm>  // sort
+
+
+/// Computes a fast fingerprint of the file content without reading the whole file.
+/** For WADs it covers the whole lump directory and the map-definition lumps, for ZIPs the whole central directory
+  * (which contains CRC-32 of every entry), for other files the beginning and the end.
+  * Returns 0 when the file cannot be read. */
+uint64_t fingerprintFileContent( const QString & filePath, qint64 fileSize );
+
+
+struct FileInfoCacheStats
+{
+	int hits = 0;       ///< up-to-date entry was found
+	int misses = 0;     ///< the file had to be read
+	int rebinds = 0;    ///< the info of another file with the same content was re-used
+	int evictions = 0;  ///< entries removed from memory to stay within the budget
+	int entries = 0;    ///< number of entries currently in memory
+	qint64 bytes = 0;   ///< approximate memory footprint of the entries currently in memory
+};
 
 
 //======================================================================================================================
 /// Template for arbitrary file info cache.
-/** Implements caching of arbitrary data read from a file according to the file's last modification time. */
+/** Implements caching of arbitrary data read from a file according to the file's last modification time and size.
+  * Optionally the entries can be also matched by a fingerprint of the file content, so that the info doesn't need
+  * to be read again after the file is moved or renamed.
+  * All public methods are thread-safe. */
 
 template< typename FileInfo >
 class FileInfoCache : protected LoggingComponent {
@@ -35,65 +75,166 @@ class FileInfoCache : protected LoggingComponent {
 	{
 		UncertainFileInfo< FileInfo > fileInfo;
 		qint64 lastModified;
+		qint64 fileSize = -1;  ///< -1 when unknown (entries loaded from the older JSON cache)
+		uint64_t contentHash = 0;  ///< fingerprint of the file content, 0 when unknown
+		qint64 lastUsed = 0;  ///< seconds since epoch when the entry was last requested, 0 when unknown
+		qint64 memoryUsage = 0;  ///< approximate footprint of the entry including its key
 	};
 
+	using ContentKey = std::pair< qint64, uint64_t >;  // file size and content fingerprint
+
 	using ReadFileInfoFunc = UncertainFileInfo< FileInfo > (*)( const QString & );
 	using WriteFileInfoFunc = bool (*)( const QString &, const FileInfo & );
+	using LoadRecordFunc = bool (*)( const BinaryCacheRecord &, UncertainFileInfo< FileInfo > & );
+	using FileInfoPromise = std::promise< UncertainFileInfo< FileInfo > >;
+	using FileInfoFuture = std::shared_future< UncertainFileInfo< FileInfo > >;
+
+	// The entries are split into shards with separate locks, so that threads working with different files
+	// don't block each other.
+	struct Shard
+	{
+		mutable std::mutex mtx;
+		QHash< QString, Entry > entries;
+		QSet< QString > changedPaths;  ///< entries that haven't been written to the journal yet
+		mutable QSet< QString > uncompactedPaths;  ///< entries that are only in the journal, not in the binary cache file yet
+	};
+	static constexpr uint shardCount = 16;
+	std::array< Shard, shardCount > _shards;
 
-	QHash< QString, Entry > _cache;
 	ReadFileInfoFunc _readFileInfo;
 	WriteFileInfoFunc _writeFileInfo;
-	mutable bool _dirty = false;
+	mutable std::atomic< bool > _dirty { false };
+	mutable std::atomic< bool > _needsCompaction { false };
 
-	QElapsedTimer _timer;
+	/// Read of a file that was requested, but might be only queued in a thread pool and not started yet.
+	struct PendingRead
+	{
+		FileInfoFuture future;
+		std::shared_ptr< FileInfoPromise > promise;
+		FileStamp fileStamp;
+		std::shared_ptr< std::atomic< bool > > claimed;  ///< set by whoever performs the read
+	};
+
+	// files that are being read right now, so that concurrent requests for the same file share a single read
+	std::mutex _pendingReadsMtx;
+	QHash< QString, PendingRead > _pendingReads;
+
+	// secondary storage, entries that are not in the _shards yet are looked up here
+	mutable std::mutex _binaryCacheMtx;
+	std::shared_ptr< const BinaryCacheFile > _binaryCache;
+	int _binaryCacheSection = -1;
+	LoadRecordFunc _loadRecord = nullptr;  // set when a binary cache is attached, so that DMB-like caches don't need binary serialization
+
+	// secondary key that allows re-using the info of a file that was moved or renamed
+	std::atomic< bool > _matchByContent { false };
+	std::mutex _contentIndexMtx;
+	QHash< ContentKey, QString > _pathsByContent;
+	bool _binaryCacheContentIndexed = false;
+
+	// When the budget is exceeded, the entries that haven't been used for the longest time are removed.
+	// The same budget applies to the entries written into the binary cache file.
+	std::atomic< int > _maxEntries;
+	std::atomic< qint64 > _maxBytes;
+	std::atomic< int > _entryCount { 0 };
+	std::atomic< qint64 > _byteCount { 0 };
+	std::mutex _evictionMtx;
+	// Bumped whenever an entry that can be evicted appears, so that the eviction doesn't sort all the entries again
+	// when its previous pass ran out of entries it's allowed to evict and none appeared since then.
+	mutable std::atomic< quint64 > _evictableGeneration { 0 };
+	quint64 _exhaustedGeneration = ~quint64(0);  ///< generation at which the last eviction ran out of entries, guarded by _evictionMtx
+
+	struct
+	{
+		std::atomic< int > hits { 0 };
+		std::atomic< int > misses { 0 };
+		std::atomic< int > rebinds { 0 };
+		std::atomic< int > evictions { 0 };
+	}
+	_stats;
 
  public:
 
+	static constexpr int defaultMaxEntries = 10000;
+	static constexpr qint64 defaultMaxBytes = 16 * 1024 * 1024;
+
 	FileInfoCache( QStringView cacheName, ReadFileInfoFunc readFileInfo, WriteFileInfoFunc writeFileInfo = nullptr )
-		: LoggingComponent( u"FileInfoCache", cacheName ), _readFileInfo( readFileInfo ), _writeFileInfo( writeFileInfo ) {}
+		: LoggingComponent( u"FileInfoCache", cacheName ), _readFileInfo( readFileInfo ), _writeFileInfo( writeFileInfo ),
+		  _maxEntries( defaultMaxEntries ), _maxBytes( defaultMaxBytes ) {}
 
 	/// Reads selected information from a file and stores it into a cache.
-	/** If the file was already read earlier and was not modified since, it returns the cached info. */
-	const UncertainFileInfo< FileInfo > & getFileInfo( const QString & filePath )
+	/** If the file was already read earlier and was not modified since, it returns the cached info.
+	  * Can be called from any thread. If another thread is already reading the same file, this waits for its result. */
+	UncertainFileInfo< FileInfo > getFileInfo( const QString & filePath )
 	{
-		auto fileLastModified = QFileInfo( filePath ).lastModified().toSecsSinceEpoch();
-
-		auto cacheIter = _cache.find( filePath );
-		Entry * cacheEntry = cacheIter != _cache.end() ? &cacheIter.value() : nullptr;
-
-		if (cacheEntry == nullptr)
+		FileStamp fileStamp = getFileStamp( filePath );
+		if (std::optional< UncertainFileInfo< FileInfo > > cachedInfo = findUpToDateInfo( filePath, fileStamp ))
 		{
-			logDebug() << "entry not found, reading info from file: " << filePath;
-			cacheEntry = nullptr;
+			return std::move( *cachedInfo );
 		}
-		else if (cacheEntry->lastModified != fileLastModified)
+
+		auto [ pendingRead, isNew ] = registerPendingRead( filePath, fileStamp, /*claim*/true );
+		if (!isNew)  // somebody else has requested it already
 		{
-			logDebug() << "entry is outdated, reading info from file: " << filePath;
-			cacheEntry = nullptr;
+			// If the read is only queued in a thread pool, do it right here instead of waiting for it. The pool might be
+			// occupied by tasks that wait for this thread, or by other reads that are stuck on an unresponsive drive.
+			if (!pendingRead.claimed->exchange( true ))
+			{
+				return resolvePendingRead( filePath, pendingRead.fileStamp, *pendingRead.promise );
+			}
+			return pendingRead.future.get();
 		}
-		else if (cacheEntry->fileInfo.status == ReadStatus::NotFound
-		      || cacheEntry->fileInfo.status == ReadStatus::CantOpen
-			  || cacheEntry->fileInfo.status == ReadStatus::FailedToRead)
+
+		return resolvePendingRead( filePath, fileStamp, *pendingRead.promise );
+	}
+
+	/// Non-blocking version of getFileInfo(), the file is read in a background thread.
+	/** Concurrent requests for the same file share a single read.
+	  * When the file is already cached, an already finished future is returned without starting any thread. */
+	FileInfoFuture getFileInfoAsync( const QString & filePath )
+	{
+		FileStamp fileStamp = getFileStamp( filePath );
+		if (std::optional< UncertainFileInfo< FileInfo > > cachedInfo = findUpToDateInfo( filePath, fileStamp ))
 		{
-			logDebug() << "reading file failed last time, trying again: " << filePath;
-			cacheEntry = nullptr;
+			FileInfoPromise finished;
+			finished.set_value( std::move( *cachedInfo ) );
+			return finished.get_future().share();
 		}
-		else if (cacheEntry->fileInfo.status == ReadStatus::Uninitialized)
+
+		auto [ pendingRead, isNew ] = registerPendingRead( filePath, fileStamp, /*claim*/false );
+		if (isNew)
 		{
-			logRuntimeError() << "entry is corrupted, reading info from file: " << filePath;
-			cacheEntry = nullptr;
+			backgroundThreadPool().start( [ this, filePath, pendingRead = pendingRead ]()
+			{
+				// somebody who needed the result sooner might have already done it, see getFileInfo()
+				if (!pendingRead.claimed->exchange( true ))
+				{
+					resolvePendingRead( filePath, pendingRead.fileStamp, *pendingRead.promise );
+				}
+			});
 		}
-		else
+		return pendingRead.future;
+	}
+
+	/// Reads selected information from multiple files at once and stores it into a cache.
+	/** Files that were already read earlier and were not modified since are taken from the cache,
+	  * the rest is read in parallel using all available CPU cores.
+	  * The returned list contains the info for each of filePaths in the original order. */
+	QList< UncertainFileInfo< FileInfo > > getFileInfos( const QStringList & filePaths )
+	{
+		// duplicate paths don't need special handling, the second request just waits for the result of the first one
+		std::vector< UncertainFileInfo< FileInfo > > results( size_t( filePaths.size() ) );
+		parallelFor( int( filePaths.size() ), [ this, &filePaths, &results ]( int idx )
 		{
-			//logDebug() << "using cached info: " << filePath;
-		}
+			results[ size_t( idx ) ] = getFileInfo( filePaths[ idx ] );
+		});
 
-		if (cacheEntry == nullptr)
+		QList< UncertainFileInfo< FileInfo > > fileInfos;
+		fileInfos.reserve( qsize_t( results.size() ) );
+		for (UncertainFileInfo< FileInfo > & fileInfo : results)
 		{
-			cacheEntry = readFileInfoToCache( filePath, fileLastModified );
+			fileInfos.append( std::move( fileInfo ) );
 		}
-
-		return cacheEntry->fileInfo;
+		return fileInfos;
 	}
 
 	/// Manually updates a record in the cache and writes the content to the corresponding file.
@@ -102,32 +243,79 @@ class FileInfoCache : protected LoggingComponent {
 	{
 		logDebug() << "writing info to cache and file: " << filePath;
 
-		Entry & newEntry = _cache.insert( filePath, {} ).value();
+		UncertainFileInfo< FileInfo > newInfo;
+		static_cast< FileInfo & >( newInfo ) = std::move( fileInfo );
+		newInfo.status = ReadStatus::Success;
 
-		static_cast< FileInfo & >( newEntry.fileInfo ) = std::move( fileInfo );
-		newEntry.fileInfo.status = ReadStatus::Success;
-		newEntry.lastModified = QDateTime::currentSecsSinceEpoch();
+		{
+			Shard & shard = shardFor( filePath );
+			std::unique_lock< std::mutex > lock( shard.mtx );
+
+			Entry newEntry;
+			newEntry.fileInfo = newInfo;
+			newEntry.lastModified = QDateTime::currentSecsSinceEpoch();
+			newEntry.lastUsed = newEntry.lastModified;
+			putEntry( shard, filePath, std::move(newEntry) );
+		}
+		_evictableGeneration++;
+		evictIfOverBudget();
 
-		return _writeFileInfo( filePath, newEntry.fileInfo );
+		bool written = _writeFileInfo( filePath, newInfo );
+		g_fileStatCache.invalidate( filePath );  // don't compare the new entry with the stamp from before the write
+		return written;
 	}
 
-	/// Indicates whether the cache has been modified since the last time it was loaded from file or dumped to file.
+	/// Indicates whether the cache has been modified since the last time it was loaded from file or dumped to file or journal.
 	bool isDirty() const  { return _dirty; }
 
+	/// Indicates whether the binary cache file contains more entries than allowed and should be rewritten.
+	bool needsCompaction() const  { return _needsCompaction; }
+
+	/// Enables matching the entries also by a fingerprint of the file content.
+	/** When a file is not found in the cache or is outdated, its fingerprint is computed and if another cached file
+	  * has the same size and fingerprint, its info is re-used instead of reading the file.
+	  * Costs reading the parts of each uncached file that determine its info: the header, the lump directory and
+	  * the MAPINFO lumps of a WAD, the whole central directory of a zip, or the first and last 64 KiB of other files. */
+	void setContentMatching( bool enabled )  { _matchByContent = enabled; }
+
+	/// Limits the number of entries and their approximate memory footprint. 0 means unlimited.
+	/** Entries that haven't been used for the longest time are evicted first. */
+	void setBudget( int maxEntries, qint64 maxBytes )
+	{
+		_maxEntries = maxEntries;
+		_maxBytes = maxBytes;
+		_evictableGeneration++;  // the new budget might need more or less to be evicted
+		evictIfOverBudget();
+	}
+
+	FileInfoCacheStats stats() const
+	{
+		return {
+			_stats.hits.load(), _stats.misses.load(), _stats.rebinds.load(), _stats.evictions.load(),
+			_entryCount.load(), _byteCount.load()
+		};
+	}
+
+	void logStats() const
+	{
+		logInfo() << "hits: "<<_stats.hits.load()<<", misses: "<<_stats.misses.load()<<", rebinds: "<<_stats.rebinds.load()
+		          << ", evictions: "<<_stats.evictions.load()<<", entries: "<<_entryCount.load()<<", bytes: "<<_byteCount.load();
+	}
+
 	QJsonObject serialize() const
 	{
 		QJsonObject jsMap;
 
-		for (auto iter = _cache.begin(); iter != _cache.end(); ++iter)
+		forEachEntry( [ &jsMap ]( const QString & filePath, const Entry & entry )
 		{
 			// don't save invalid or empty entries
-			if (iter->fileInfo.status == ReadStatus::Uninitialized || iter->fileInfo.status == ReadStatus::NotSupported)
+			if (entry.fileInfo.status == ReadStatus::Uninitialized || entry.fileInfo.status == ReadStatus::NotSupported)
 			{
-				continue;
+				return;
 			}
 
-			jsMap[ iter.key() ] = serialize( iter.value() );
-		}
+			jsMap[ filePath ] = serialize( entry );
+		});
 
 		_dirty = false;
 
@@ -165,53 +353,717 @@ class FileInfoCache : protected LoggingComponent {
 				continue;
 			}
 
-			_cache.insert( std::move(filePath), std::move(entry) );
+			Shard & shard = shardFor( filePath );
+			std::unique_lock< std::mutex > lock( shard.mtx );
+			putEntry( shard, filePath, std::move(entry) );
+		}
+
+		_evictableGeneration++;
+		evictIfOverBudget();
+	}
+
+	/// Writes all valid entries into a new section of a binary cache file.
+	/** Entries of the currently attached binary cache that haven't been requested in this session are carried over
+	  * as they are, without deserializing them, unless their file no longer exists or they don't fit into the budget. */
+	void serialize( BinaryCacheWriter & cacheWriter, const QString & sectionName ) const
+	{
+		cacheWriter.beginSection( sectionName );
+
+		int writtenEntries = 0;
+		qint64 writtenBytes = 0;
+
+		for (const Shard & shard : _shards)
+		{
+			std::unique_lock< std::mutex > lock( shard.mtx );
+			for (auto iter = shard.entries.begin(); iter != shard.entries.end(); ++iter)
+			{
+				const QString & filePath = iter.key();
+				const Entry & entry = iter.value();
+
+				// the current version goes into the new file, so it's no longer needed to keep it in memory
+				shard.uncompactedPaths.remove( filePath );
+
+				// don't save invalid or empty entries
+				if (entry.fileInfo.status == ReadStatus::Uninitialized || entry.fileInfo.status == ReadStatus::NotSupported)
+				{
+					continue;
+				}
+
+				cacheWriter.addRecord(
+					filePath, entry.lastModified, entry.fileSize, entry.contentHash, entry.lastUsed,
+					entry.fileInfo.status, serializePayload( entry.fileInfo )
+				);
+				writtenEntries++;
+				writtenBytes += entry.memoryUsage;
+			}
+		}
+
+		AttachedBinaryCache binaryCache = attachedBinaryCache();
+		if (binaryCache.file)
+		{
+			// the records point into the mapped file, which stays mapped as long as binaryCache exists
+			std::vector< BinaryCacheRecord > carriedOver;
+			binaryCache.file->forEachRecord( binaryCache.sectionIdx, [ & ]( const BinaryCacheRecord & record )
+			{
+				QString filePath = record.filePath.toString();
+				if (containsEntry( filePath ))
+				{
+					return;  // already written above
+				}
+				if (!fs::isValidFile( filePath ))
+				{
+					logDebug() << "removing entry, file no longer exists: " << filePath;
+					return;
+				}
+				carriedOver.push_back( record );
+			});
+
+			// the most recently used records have the priority
+			std::sort( carriedOver.begin(), carriedOver.end(), []( const BinaryCacheRecord & a, const BinaryCacheRecord & b )
+			{
+				return a.lastUsed > b.lastUsed;
+			});
+
+			const int maxEntries = _maxEntries;
+			const qint64 maxBytes = _maxBytes;
+			int droppedEntries = 0;
+			for (const BinaryCacheRecord & record : carriedOver)
+			{
+				// the payload is the closest estimate of how big the entry will be once it's loaded
+				qint64 recordBytes = qint64( sizeof(Entry) ) + qint64( record.filePath.size() ) * qint64( sizeof(QChar) ) + record.payload.size();
+				if ((maxEntries > 0 && writtenEntries + 1 > maxEntries) || (maxBytes > 0 && writtenBytes + recordBytes > maxBytes))
+				{
+					droppedEntries++;
+					continue;
+				}
+
+				// deep copy, because the payload points into the mapped file which is about to be overwritten
+				QByteArray payload( record.payload.constData(), record.payload.size() );
+				cacheWriter.addRecord(
+					record.filePath.toString(), record.lastModified, record.fileSize, record.contentHash, record.lastUsed,
+					record.status, std::move(payload)
+				);
+				writtenEntries++;
+				writtenBytes += recordBytes;
+			}
+			if (droppedEntries > 0)
+			{
+				logDebug() << "dropping "<<droppedEntries<<" least recently used entries that don't fit into the budget";
+			}
+		}
+
+		// The changed entries are not unmarked, because this can run in a background thread concurrently
+		// with modifications, and the journal will be deleted only after the new file is successfully written.
+		// Writing them into the new journal again is harmless.
+		_needsCompaction = false;
+
+		_evictableGeneration++;  // the entries that were only in the journal can be evicted now
+	}
+
+	/// Writes the entries that were added or modified since the last call into the journal.
+	void serializeChanges( BinaryCacheJournalWriter & journalWriter, const QString & sectionName )
+	{
+		journalWriter.beginSection( sectionName );
+
+		_dirty = false;  // cleared before collecting, so that changes made in the meantime are not lost
+
+		for (Shard & shard : _shards)
+		{
+			std::unique_lock< std::mutex > lock( shard.mtx );
+
+			for (const QString & filePath : std::as_const( shard.changedPaths ))
+			{
+				auto entryIter = shard.entries.find( filePath );
+				if (entryIter == shard.entries.end())
+				{
+					continue;  // removed in the meantime
+				}
+				const Entry & entry = entryIter.value();
+				if (entry.fileInfo.status == ReadStatus::Uninitialized || entry.fileInfo.status == ReadStatus::NotSupported)
+				{
+					continue;
+				}
+
+				journalWriter.addRecord(
+					filePath, entry.lastModified, entry.fileSize, entry.contentHash, entry.lastUsed,
+					entry.fileInfo.status, serializePayload( entry.fileInfo )
+				);
+				// If it was evicted before the next compaction, the older record from the binary cache file
+				// would be carried over instead and the journal deleted.
+				shard.uncompactedPaths.insert( filePath );
+			}
+			shard.changedPaths.clear();
+		}
+
+		_evictableGeneration++;  // the invalid entries that are not written can be evicted now
+	}
+
+	/// Applies a record read from the journal, it replaces the entry from the binary cache file.
+	void replayJournalRecord( const BinaryCacheRecord & record )
+	{
+		QString filePath = record.filePath.toString();
+
+		Entry entry;
+		entry.lastModified = record.lastModified;
+		entry.fileSize = record.fileSize;
+		entry.contentHash = record.contentHash;
+		entry.lastUsed = record.lastUsed;
+		if (!loadRecord( record, entry.fileInfo ))
+		{
+			logRuntimeError() << "journal entry is corrupted: " << filePath;
+			return;
+		}
+
+		if (entry.contentHash != 0 && isDerivedFromContent( entry.fileInfo.status ))
+		{
+			std::unique_lock< std::mutex > lock( _contentIndexMtx );
+			_pathsByContent.insert( { entry.fileSize, entry.contentHash }, filePath );
+		}
+		{
+			Shard & shard = shardFor( filePath );
+			std::unique_lock< std::mutex > lock( shard.mtx );
+			putEntry( shard, filePath, std::move(entry) );
+			// the binary cache file has an older version, this one must stay in memory until the next compaction
+			shard.uncompactedPaths.insert( filePath );
+		}
+
+		evictIfOverBudget();
+	}
+
+	/// Attaches a section of a binary cache file as a secondary storage.
+	/** Entries are not loaded now, but only when they are requested and not found in the in-memory cache. */
+	void attachBinaryCache( std::shared_ptr< const BinaryCacheFile > cacheFile, const QString & sectionName )
+	{
+		{
+			std::unique_lock< std::mutex > lock( _binaryCacheMtx );
+			_binaryCacheSection = cacheFile ? cacheFile->findSection( sectionName ) : -1;
+			_binaryCache = _binaryCacheSection >= 0 ? std::move( cacheFile ) : nullptr;
+			_loadRecord = &loadRecord;
+
+			// the file was written with a bigger budget, make sure it gets trimmed
+			int maxEntries = _maxEntries;
+			if (_binaryCache && maxEntries > 0 && _binaryCache->recordCount( _binaryCacheSection ) > maxEntries)
+			{
+				_needsCompaction = true;
+			}
+		}
+		std::unique_lock< std::mutex > lock( _contentIndexMtx );
+		_binaryCacheContentIndexed = false;
+	}
+
+	/// The currently attached binary cache file, null when there is none.
+	std::shared_ptr< const BinaryCacheFile > binaryCacheFile() const
+	{
+		return attachedBinaryCache().file;
+	}
+
+	/// Releases the binary cache file.
+	/** The file stays mapped until the reads that are in progress in other threads finish. */
+	void detachBinaryCache()
+	{
+		{
+			std::unique_lock< std::mutex > lock( _binaryCacheMtx );
+			_binaryCache.reset();
+			_binaryCacheSection = -1;
 		}
+		std::unique_lock< std::mutex > lock( _contentIndexMtx );
+		_binaryCacheContentIndexed = false;
 	}
 
  private:
 
-	Entry * readFileInfoToCache( const QString & filePath, qint64 fileModifiedTimestamp )
+	// Locking order: shard -> content index -> binary cache, the pending reads are never locked together with anything.
+
+	Shard & shardFor( const QString & filePath )
+	{
+		return _shards[ qHash( filePath ) % shardCount ];
+	}
+	const Shard & shardFor( const QString & filePath ) const
+	{
+		return _shards[ qHash( filePath ) % shardCount ];
+	}
+
+	template< typename Func >
+	void forEachEntry( const Func & loopBody ) const
+	{
+		for (const Shard & shard : _shards)
+		{
+			std::unique_lock< std::mutex > lock( shard.mtx );
+			for (auto iter = shard.entries.begin(); iter != shard.entries.end(); ++iter)
+			{
+				loopBody( iter.key(), iter.value() );
+			}
+		}
+	}
+
+	bool containsEntry( const QString & filePath ) const
+	{
+		const Shard & shard = shardFor( filePath );
+		std::unique_lock< std::mutex > lock( shard.mtx );
+		return shard.entries.contains( filePath );
+	}
+
+	/// Inserts or replaces an entry and updates the size accounting. The shard must be locked by the caller.
+	Entry & putEntry( Shard & shard, const QString & filePath, Entry entry )
+	{
+		entry.memoryUsage = qint64( sizeof(Entry) ) + heapSize( filePath ) + entry.fileInfo.memoryUsage();
+
+		auto entryIter = shard.entries.find( filePath );
+		if (entryIter != shard.entries.end())
+		{
+			_byteCount += entry.memoryUsage - entryIter->memoryUsage;
+			*entryIter = std::move(entry);
+			return *entryIter;
+		}
+
+		_entryCount++;
+		_byteCount += entry.memoryUsage;
+		return shard.entries.insert( filePath, std::move(entry) ).value();
+	}
+
+	/// Removes an entry and updates the size accounting. The shard must be locked by the caller.
+	void removeEntry( Shard & shard, typename QHash< QString, Entry >::iterator entryIter )
+	{
+		_entryCount--;
+		_byteCount -= entryIter->memoryUsage;
+		shard.uncompactedPaths.remove( entryIter.key() );
+		shard.entries.erase( entryIter );
+	}
+
+	bool exceedsBudget( int entryCount, qint64 byteCount, int maxEntries, qint64 maxBytes ) const
+	{
+		return (maxEntries > 0 && entryCount > maxEntries) || (maxBytes > 0 && byteCount > maxBytes);
+	}
+
+	/// Removes the least recently used entries from memory until the cache fits into the budget.
+	/** Must not be called with any shard locked. */
+	void evictIfOverBudget()
+	{
+		const int maxEntries = _maxEntries;
+		const qint64 maxBytes = _maxBytes;
+		if (!exceedsBudget( _entryCount, _byteCount, maxEntries, maxBytes ))
+		{
+			return;
+		}
+
+		std::unique_lock< std::mutex > evictionLock( _evictionMtx, std::try_to_lock );
+		if (!evictionLock.owns_lock())
+		{
+			return;  // another thread is already doing it
+		}
+
+		const quint64 generation = _evictableGeneration;
+		if (generation == _exhaustedGeneration)
+		{
+			return;  // nothing that could be evicted has appeared since the last time, all the rest must stay until saved
+		}
+
+		// Evict a bit more than necessary, so that this doesn't have to run again after each new entry.
+		const int targetEntries = maxEntries - maxEntries / 8;
+		const qint64 targetBytes = maxBytes - maxBytes / 8;
+
+		struct Candidate
+		{
+			qint64 lastUsed;
+			uint shardIdx;
+			QString filePath;
+		};
+		std::vector< Candidate > candidates;
+		candidates.reserve( size_t( std::max( _entryCount.load(), 0 ) ) );
+		for (uint shardIdx = 0; shardIdx < shardCount; ++shardIdx)
+		{
+			std::unique_lock< std::mutex > lock( _shards[ shardIdx ].mtx );
+			const auto & entries = _shards[ shardIdx ].entries;
+			for (auto entryIter = entries.begin(); entryIter != entries.end(); ++entryIter)
+			{
+				candidates.push_back({ entryIter->lastUsed, shardIdx, entryIter.key() });
+			}
+		}
+		std::sort( candidates.begin(), candidates.end(), []( const Candidate & a, const Candidate & b )
+		{
+			return a.lastUsed < b.lastUsed;
+		});
+
+		int evicted = 0;
+		bool skippedUncompacted = false;
+		bool skippedUsed = false;
+		for (const Candidate & candidate : candidates)
+		{
+			if (!exceedsBudget( _entryCount, _byteCount, targetEntries, targetBytes ))
+			{
+				break;
+			}
+
+			Shard & shard = _shards[ candidate.shardIdx ];
+			std::unique_lock< std::mutex > lock( shard.mtx );
+
+			auto entryIter = shard.entries.find( candidate.filePath );
+			if (entryIter == shard.entries.end())
+			{
+				continue;  // removed in the meantime
+			}
+			if (entryIter->lastUsed > candidate.lastUsed)
+			{
+				skippedUsed = true;
+				continue;  // used in the meantime
+			}
+			if (shard.changedPaths.contains( candidate.filePath ))
+			{
+				continue;  // not saved yet
+			}
+			if (shard.uncompactedPaths.contains( candidate.filePath ))
+			{
+				skippedUncompacted = true;
+				continue;  // saved only in the journal
+			}
+
+			if (entryIter->contentHash != 0)
+			{
+				std::unique_lock< std::mutex > contentIndexLock( _contentIndexMtx );
+				auto pathIter = _pathsByContent.find( { entryIter->fileSize, entryIter->contentHash } );
+				if (pathIter != _pathsByContent.end() && pathIter.value() == candidate.filePath)
+				{
+					_pathsByContent.erase( pathIter );
+				}
+			}
+
+			removeEntry( shard, entryIter );
+			evicted++;
+		}
+
+		_stats.evictions += evicted;
+
+		if (exceedsBudget( _entryCount, _byteCount, targetEntries, targetBytes ))
+		{
+			// the entries that are only in the journal can be evicted after they are written into the binary cache file
+			if (skippedUncompacted)
+				_needsCompaction = true;
+			// everything else is waiting to be saved, there is no point in trying again until that changes
+			if (!skippedUsed)
+				_exhaustedGeneration = generation;
+		}
+		logDebug() << "evicted "<<evicted<<" least recently used entries, remaining: "<<_entryCount.load()<<" entries, "<<_byteCount.load()<<" bytes";
+	}
+
+	struct AttachedBinaryCache
+	{
+		std::shared_ptr< const BinaryCacheFile > file;  ///< keeps the file mapped even if it's detached in the meantime
+		int sectionIdx;
+		LoadRecordFunc loadRecord;
+	};
+	AttachedBinaryCache attachedBinaryCache() const
+	{
+		std::unique_lock< std::mutex > lock( _binaryCacheMtx );
+		return { _binaryCache, _binaryCacheSection, _loadRecord };
+	}
+
+	static FileStamp getFileStamp( const QString & filePath )
+	{
+		return g_fileStatCache.getFileStamp( filePath );
+	}
+
+	/// Returns either a read that was already requested, or registers a new one that the caller must perform.
+	/** When \p claim is false, the new read is not claimed yet and whoever claims it first must perform it.
+	  * The second returned value is true when the read is new. */
+	std::pair< PendingRead, bool > registerPendingRead( const QString & filePath, FileStamp fileStamp, bool claim )
+	{
+		std::unique_lock< std::mutex > lock( _pendingReadsMtx );
+
+		auto pendingIter = _pendingReads.find( filePath );
+		if (pendingIter != _pendingReads.end())
+		{
+			return { pendingIter.value(), false };
+		}
+
+		PendingRead pendingRead;
+		pendingRead.promise = std::make_shared< FileInfoPromise >();
+		pendingRead.future = pendingRead.promise->get_future().share();
+		pendingRead.fileStamp = fileStamp;
+		pendingRead.claimed = std::make_shared< std::atomic< bool > >( claim );
+		_pendingReads.insert( filePath, pendingRead );
+		return { std::move( pendingRead ), true };
+	}
+
+	UncertainFileInfo< FileInfo > resolvePendingRead( const QString & filePath, FileStamp fileStamp, FileInfoPromise & promise )
+	{
+		UncertainFileInfo< FileInfo > fileInfo = resolveFileInfo( filePath, fileStamp );
+
+		// the result is already in the cache, so any request coming after the removal will find it there
+		promise.set_value( fileInfo );
+		std::unique_lock< std::mutex > lock( _pendingReadsMtx );
+		_pendingReads.remove( filePath );
+
+		return fileInfo;
+	}
+
+	/// Gets the info of a file that is not in the cache, either from another file with the same content or by reading it.
+	UncertainFileInfo< FileInfo > resolveFileInfo( const QString & filePath, FileStamp fileStamp )
+	{
+		uint64_t contentHash = _matchByContent ? fingerprintFileContent( filePath, fileStamp.fileSize ) : 0;
+
+		if (std::optional< UncertainFileInfo< FileInfo > > reboundInfo = rebindEntryWithSameContent( filePath, fileStamp, contentHash ))
+		{
+			return std::move( *reboundInfo );
+		}
+
+		QElapsedTimer timer;
+		timer.start();
+		UncertainFileInfo< FileInfo > fileInfo = _readFileInfo( filePath );
+		auto elapsed = timer.elapsed();
+
+		storeFileInfo( filePath, fileInfo, fileStamp, contentHash, elapsed );
+
+		return fileInfo;
+	}
+
+	/// Returns a copy of the cached info if it exists and can be used, otherwise the file must be read again.
+	std::optional< UncertainFileInfo< FileInfo > > findUpToDateInfo( const QString & filePath, FileStamp fileStamp )
+	{
+		std::optional< UncertainFileInfo< FileInfo > > cachedInfo;
+		{
+			Shard & shard = shardFor( filePath );
+			std::unique_lock< std::mutex > lock( shard.mtx );
+			cachedInfo = findUpToDateInfo( shard, filePath, fileStamp );
+		}
+		evictIfOverBudget();  // the entry might have been loaded from the binary cache
+		return cachedInfo;
+	}
+
+	/// The shard must be locked by the caller.
+	std::optional< UncertainFileInfo< FileInfo > > findUpToDateInfo( Shard & shard, const QString & filePath, FileStamp fileStamp )
+	{
+		Entry * cacheEntry = findOrLoadEntry( shard, filePath );
+
+		if (cacheEntry != nullptr)
+		{
+			cacheEntry->lastUsed = QDateTime::currentSecsSinceEpoch();
+		}
+
+		if (cacheEntry == nullptr)
+		{
+			logDebug() << "entry not found, reading info from file: " << filePath;
+			return std::nullopt;
+		}
+		else if (cacheEntry->lastModified != fileStamp.lastModified || (cacheEntry->fileSize >= 0 && cacheEntry->fileSize != fileStamp.fileSize))
+		{
+			logDebug() << "entry is outdated, reading info from file: " << filePath;
+			return std::nullopt;
+		}
+		else if (cacheEntry->fileInfo.status == ReadStatus::NotFound
+		      || cacheEntry->fileInfo.status == ReadStatus::CantOpen
+			  || cacheEntry->fileInfo.status == ReadStatus::FailedToRead)
+		{
+			logDebug() << "reading file failed last time, trying again: " << filePath;
+			return std::nullopt;
+		}
+		else if (cacheEntry->fileInfo.status == ReadStatus::Uninitialized)
+		{
+			logRuntimeError() << "entry is corrupted, reading info from file: " << filePath;
+			return std::nullopt;
+		}
+		else
+		{
+			//logDebug() << "using cached info: " << filePath;
+			_stats.hits++;
+			return cacheEntry->fileInfo;
+		}
+	}
+
+	/// Returns the entry from the shard, or moves it there from the attached binary cache file, or returns nullptr.
+	/** The shard must be locked by the caller. */
+	Entry * findOrLoadEntry( Shard & shard, const QString & filePath )
+	{
+		auto cacheIter = shard.entries.find( filePath );
+		if (cacheIter != shard.entries.end())
+		{
+			return &cacheIter.value();
+		}
+
+		AttachedBinaryCache binaryCache = attachedBinaryCache();
+		BinaryCacheRecord record;
+		if (!binaryCache.file || !binaryCache.file->findRecord( binaryCache.sectionIdx, filePath, record ))
+		{
+			return nullptr;
+		}
+
+		Entry entry;
+		entry.lastModified = record.lastModified;
+		entry.fileSize = record.fileSize;
+		entry.contentHash = record.contentHash;
+		entry.lastUsed = record.lastUsed;
+		if (!binaryCache.loadRecord( record, entry.fileInfo ))
+		{
+			logRuntimeError() << "binary cache entry is corrupted: " << filePath;
+			return nullptr;
+		}
+
+		if (entry.contentHash != 0 && isDerivedFromContent( entry.fileInfo.status ))
+		{
+			std::unique_lock< std::mutex > lock( _contentIndexMtx );
+			_pathsByContent.insert( { entry.fileSize, entry.contentHash }, filePath );
+		}
+
+		_evictableGeneration++;
+
+		return &putEntry( shard, filePath, std::move(entry) );
+	}
+
+	static bool isDerivedFromContent( ReadStatus status )
+	{
+		return status == ReadStatus::Success || status == ReadStatus::InvalidFormat || status == ReadStatus::InfoNotPresent;
+	}
+
+	/// Looks for an entry of another file with the same content and if found, copies it to an entry for this file.
+	/** The entry of the same file is never re-used, because when a file is modified in place, its size is often kept
+	  * and the modification might be outside the parts covered by the fingerprint. */
+	std::optional< UncertainFileInfo< FileInfo > > rebindEntryWithSameContent(
+		const QString & filePath, FileStamp fileStamp, uint64_t contentHash
+	){
+		if (contentHash == 0)
+		{
+			return std::nullopt;
+		}
+
+		indexBinaryCacheContent();
+
+		QString origFilePath;
+		{
+			std::unique_lock< std::mutex > lock( _contentIndexMtx );
+			auto pathIter = _pathsByContent.find( { fileStamp.fileSize, contentHash } );
+			if (pathIter == _pathsByContent.end() || pathIter.value() == filePath)
+			{
+				return std::nullopt;
+			}
+			origFilePath = pathIter.value();
+		}
+
+		Entry newEntry;
+		{
+			Shard & origShard = shardFor( origFilePath );
+			std::unique_lock< std::mutex > lock( origShard.mtx );
+
+			Entry * origEntry = findOrLoadEntry( origShard, origFilePath );
+			if (!origEntry || origEntry->contentHash != contentHash || !isDerivedFromContent( origEntry->fileInfo.status ))
+			{
+				return std::nullopt;
+			}
+			newEntry = *origEntry;
+
+			if (!fs::isValidFile( origFilePath ))  // moved, not copied -> the original entry is no longer needed
+			{
+				removeEntry( origShard, origShard.entries.find( origFilePath ) );
+			}
+		}
+
+		logDebug() << "content matches "<<origFilePath<<", re-using its info for: " << filePath;
+
+		newEntry.lastModified = fileStamp.lastModified;
+		newEntry.fileSize = fileStamp.fileSize;
+		newEntry.lastUsed = QDateTime::currentSecsSinceEpoch();
+		UncertainFileInfo< FileInfo > fileInfo = newEntry.fileInfo;
+
+		{
+			Shard & shard = shardFor( filePath );
+			std::unique_lock< std::mutex > lock( shard.mtx );
+			putEntry( shard, filePath, std::move(newEntry) );
+			shard.changedPaths.insert( filePath );
+		}
+		{
+			std::unique_lock< std::mutex > lock( _contentIndexMtx );
+			_pathsByContent.insert( { fileStamp.fileSize, contentHash }, filePath );
+		}
+		_stats.rebinds++;
+		_dirty = true;
+
+		evictIfOverBudget();
+
+		return fileInfo;
+	}
+
+	/// Adds the entries of the attached binary cache file into the content index, without loading them.
+	void indexBinaryCacheContent()
 	{
-		Entry & newEntry = _cache.insert( filePath, {} ).value();
+		std::unique_lock< std::mutex > lock( _contentIndexMtx );
+
+		if (_binaryCacheContentIndexed)
+		{
+			return;
+		}
 
-		_timer.restart();
-		newEntry.fileInfo = _readFileInfo( filePath );
-		auto elapsed = _timer.elapsed();
+		AttachedBinaryCache binaryCache = attachedBinaryCache();
+		if (!binaryCache.file)
+		{
+			return;
+		}
 
-		switch (newEntry.fileInfo.status)
+		binaryCache.file->forEachRecord( binaryCache.sectionIdx, [ this ]( const BinaryCacheRecord & record )
+		{
+			ContentKey contentKey( record.fileSize, record.contentHash );
+			if (record.contentHash != 0 && !_pathsByContent.contains( contentKey ))
+			{
+				_pathsByContent.insert( contentKey, record.filePath.toString() );
+			}
+		});
+		_binaryCacheContentIndexed = true;
+	}
+
+	void storeFileInfo(
+		const QString & filePath, const UncertainFileInfo< FileInfo > & fileInfo,
+		FileStamp fileStamp, uint64_t contentHash, qint64 elapsed
+	){
+		switch (fileInfo.status)
 		{
 			case ReadStatus::Success:
-				logDebug() << " -> success (took "<<elapsed<<"ms)";
+				logDebug() << filePath << " -> success (took "<<elapsed<<"ms)";
 				break;
 			case ReadStatus::NotSupported:
-				logDebug() << " -> not implemented";
+				logDebug() << filePath << " -> not implemented";
 				break;
 			case ReadStatus::NotFound:
-				logDebug() << " -> file not found";
+				logDebug() << filePath << " -> file not found";
 				break;
 			case ReadStatus::CantOpen:
-				logDebug() << " -> couldn't open file";
+				logDebug() << filePath << " -> couldn't open file";
 				break;
 			case ReadStatus::FailedToRead:
-				logDebug() << " -> failed to read file";
+				logDebug() << filePath << " -> failed to read file";
 				break;
 			case ReadStatus::InvalidFormat:
-				logDebug() << " -> unexpected format";
+				logDebug() << filePath << " -> unexpected format";
 				break;
 			case ReadStatus::InfoNotPresent:
-				logDebug() << " -> info not present";
+				logDebug() << filePath << " -> info not present";
 				break;
 			default:
-				logLogicError() << " -> read function returned unrecognized status: "
-				                << fut::to_underlying( newEntry.fileInfo.status );
+				logLogicError() << filePath << " -> read function returned unrecognized status: "
+				                << fut::to_underlying( fileInfo.status );
 				break;
 		}
 
-		newEntry.lastModified = fileModifiedTimestamp;
+		{
+			Shard & shard = shardFor( filePath );
+			std::unique_lock< std::mutex > lock( shard.mtx );
+
+			Entry newEntry;
+			newEntry.fileInfo = fileInfo;
+			newEntry.lastModified = fileStamp.lastModified;
+			newEntry.fileSize = fileStamp.fileSize;
+			newEntry.contentHash = contentHash;
+			newEntry.lastUsed = QDateTime::currentSecsSinceEpoch();
+			putEntry( shard, filePath, std::move(newEntry) );
+			shard.changedPaths.insert( filePath );
+		}
+
+		if (contentHash != 0 && isDerivedFromContent( fileInfo.status ))
+		{
+			std::unique_lock< std::mutex > lock( _contentIndexMtx );
+			_pathsByContent.insert( { fileStamp.fileSize, contentHash }, filePath );
+		}
+
+		_stats.misses++;
 		_dirty = true;
 
-		return &newEntry;
+		evictIfOverBudget();
 	}
 
 	static QJsonObject serialize( const Entry & cacheEntry )
@@ -234,6 +1086,24 @@ class FileInfoCache : protected LoggingComponent {
 		cacheEntry.fileInfo.deserialize( jsFileInfo );
 	}
 
+	static QByteArray serializePayload( const FileInfo & fileInfo )
+	{
+		QByteArray payload;
+		QDataStream stream( &payload, QIODevice::WriteOnly );
+		stream.setVersion( binaryCacheStreamVersion );
+		fileInfo.serialize( stream );
+		return payload;
+	}
+
+	static bool loadRecord( const BinaryCacheRecord & record, UncertainFileInfo< FileInfo > & fileInfo )
+	{
+		QDataStream stream( record.payload );
+		stream.setVersion( binaryCacheStreamVersion );
+		fileInfo.deserialize( stream );
+		fileInfo.status = record.status;
+		return stream.status() == QDataStream::Ok && record.status < ReadStatus::Uninitialized;
+	}
+
 };
 
 
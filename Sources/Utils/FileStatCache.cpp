@@ -0,0 +1,77 @@
+//======================================================================================================================
+// Project: DoomRunner
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: short-term cache of file modification times and sizes
+//======================================================================================================================
+
+#include "FileStatCache.hpp"
+
+#include <QFileInfo>
+#include <QDateTime>
+
+
+FileStatCache::FileStatCache()
+:
+	LoggingComponent( u"FileStatCache" ),
+	_freshnessWindowMs( defaultFreshnessWindowMs )
+{
+	_clock.start();
+}
+
+FileStamp FileStatCache::getFileStamp( const QString & filePath )
+{
+	const qint64 freshnessWindowMs = _freshnessWindowMs;
+
+	if (freshnessWindowMs > 0)
+	{
+		std::unique_lock< std::mutex > lock( _mtx );
+
+		auto entryIter = _entries.find( filePath );
+		if (entryIter != _entries.end() && _clock.elapsed() - entryIter->statTime < freshnessWindowMs)
+		{
+			return entryIter->stamp;
+		}
+	}
+
+	// the syscall itself must not block the other threads
+	QFileInfo fsEntry( filePath );
+	FileStamp stamp = { fsEntry.lastModified().toSecsSinceEpoch(), fsEntry.size() };
+
+	if (freshnessWindowMs > 0)
+	{
+		std::unique_lock< std::mutex > lock( _mtx );
+
+		const qint64 now = _clock.elapsed();
+		if (now - _lastPruneTime >= freshnessWindowMs)
+		{
+			pruneExpiredEntries( now, freshnessWindowMs );
+			_lastPruneTime = now;
+		}
+
+		_entries[ filePath ] = { stamp, now };
+	}
+
+	return stamp;
+}
+
+void FileStatCache::invalidate( const QString & filePath )
+{
+	std::unique_lock< std::mutex > lock( _mtx );
+
+	_entries.remove( filePath );
+}
+
+void FileStatCache::pruneExpiredEntries( qint64 now, qint64 freshnessWindowMs )
+{
+	for (auto entryIter = _entries.begin(); entryIter != _entries.end(); )
+	{
+		if (now - entryIter->statTime >= freshnessWindowMs)
+			entryIter = _entries.erase( entryIter );
+		else
+			++entryIter;
+	}
+}
+
+
+FileStatCache g_fileStatCache;
@@ -0,0 +1,82 @@
+//======================================================================================================================
+// Project: DoomRunner
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: short-term cache of file modification times and sizes
+//======================================================================================================================
+
+#ifndef FILE_STAT_CACHE_INCLUDED
+#define FILE_STAT_CACHE_INCLUDED
+
+
+#include "Essential.hpp"
+
+#include "ErrorHandling.hpp"  // LoggingComponent
+
+#include <QString>
+#include <QHash>
+#include <QElapsedTimer>
+
+#include <mutex>
+#include <atomic>
+
+
+/// Modification time and size of a file at some moment.
+struct FileStamp
+{
+	qint64 lastModified;  ///< seconds since epoch
+	qint64 fileSize;
+};
+
+
+//======================================================================================================================
+/// Remembers the results of stat calls for a short time, so that repeated queries for the same file are free.
+/** Checking whether a cached file info is up to date needs the modification time of the file, which costs a syscall,
+  * and on network file systems even a round trip to the server. The same files are often queried many times during
+  * a single UI update, so the results are re-used for a configurable freshness window.
+  * The file system notifications are deliberately not used to invalidate the results earlier, because watching
+  * a file costs more than the stat itself, and network file systems don't report the changes made by other machines.
+  * Only the entries within the freshness window are kept, the older ones would be queried again anyway.
+  * All methods are thread-safe. */
+
+class FileStatCache : protected LoggingComponent {
+
+	struct Entry
+	{
+		FileStamp stamp;
+		qint64 statTime;  ///< when the stamp was obtained, in milliseconds of _clock
+	};
+
+	std::mutex _mtx;
+	QHash< QString, Entry > _entries;
+	qint64 _lastPruneTime = 0;  ///< when the expired entries were last removed, in milliseconds of _clock
+	QElapsedTimer _clock;
+	std::atomic< qint64 > _freshnessWindowMs;
+
+ public:
+
+	static constexpr qint64 defaultFreshnessWindowMs = 2000;
+
+	FileStatCache();
+
+	/// Returns the modification time and size of a file, either remembered from a recent call or obtained from the OS.
+	FileStamp getFileStamp( const QString & filePath );
+
+	/// Forgets the remembered stamp of a file, for example after the application itself has modified the file.
+	void invalidate( const QString & filePath );
+
+	/// For how long the stamps are re-used. 0 disables the caching.
+	void setFreshnessWindow( qint64 milliseconds )  { _freshnessWindowMs = milliseconds; }
+
+ private:
+
+	/// Removes the entries that are no longer fresh. The mutex must be locked by the caller.
+	void pruneExpiredEntries( qint64 now, qint64 freshnessWindowMs );
+
+};
+
+/// shared by all the file info caches, because they often query the same files
+extern FileStatCache g_fileStatCache;
+
+
+#endif // FILE_STAT_CACHE_INCLUDED
@@ -9,6 +9,7 @@
 
 #include "CommonTypes.hpp"  // qsize_t
 #include "StringUtils.hpp"
+#include "ThreadUtils.hpp"  // parallelFor
 
 #include <QDirIterator>
 #include <QFile>
@@ -43,6 +44,15 @@
 	#endif // QT_VERSION < 6.6
 #endif // IS_WINDOWS
 
+#include <deque>
+#include <vector>
+#include <algorithm>
+
+#if !IS_WINDOWS
+	#include <dirent.h>
+	#include <memory>
+#endif
+
 
 //======================================================================================================================
 // general helper functions
@@ -196,41 +206,254 @@ bool deleteFile( const QString & filePath )
 	return parentDir.remove( fileInfo.fileName() );
 }
 
-void traverseDirectory(
-	const QString & dir, bool recursively, EntryTypes typesToVisit,
-	const PathConvertor & pathConvertor, const std::function< void ( const QFileInfo & entry ) > & visitEntry
+/// Called for every entry of a listed directory with the original path (usable for opening the entry)
+/// and with the entry whose path is converted by the PathConvertor. Returns false when the listing should stop.
+using ListedEntryVisitor = std::function< bool ( const QString & origPath, const QFileInfo & entry, bool isDir ) >;
+
+#if !IS_WINDOWS
+
+struct DirCloser
+{
+	void operator()( DIR * dir ) const  { closedir( dir ); }
+};
+
+/// Lists a single directory using the entry types from the directory listing itself (d_type),
+/// so that the entries don't need to be stat-ed before they are visited.
+/** Only symlinks and entries on file systems that don't report the type are stat-ed to find out what they are.
+  * The QFileInfo passed to visitEntry has nothing cached yet, so the files are stat-ed only when the visitor
+  * asks about something more than their path, which is typically after they pass the suffix filter.
+  * The directory path is converted only once and the entry names are appended to it.
+  * Returns false if the listing was cancelled or stopped by the visitor. */
+static bool listDirectory(
+	const QString & dir, const QString & convertedDir, const PathConvertor & /*pathConvertor*/,
+	const ListedEntryVisitor & visitEntry, const std::atomic< bool > * cancelled
 )
 {
-	if (dir.isEmpty())
-		return;
+	std::unique_ptr< DIR, DirCloser > dirHandle( opendir( QFile::encodeName( dir ).constData() ) );
+	if (!dirHandle)
+		return true;  // doesn't exist or is not accessible, same as when the QDirIterator finds nothing
+
+	// converting a path to the directory itself can result in "." or empty string, in which case the entry name is enough
+	QString entryPrefix;
+	if (!convertedDir.isEmpty() && convertedDir != currentDir)
+		entryPrefix = convertedDir.endsWith('/') ? convertedDir : convertedDir + '/';
+
+	while (const struct dirent * dirEntry = readdir( dirHandle.get() ))
+	{
+		if (cancelled && cancelled->load( std::memory_order_relaxed ))
+			return false;
+
+		if (dirEntry->d_name[0] == '.')
+			continue;  // ".", ".." and hidden entries, those are skipped by the default QDir filter too
+
+		unsigned char entryType = dirEntry->d_type;
+		if (entryType != DT_DIR && entryType != DT_REG && entryType != DT_LNK && entryType != DT_UNKNOWN)
+			continue;  // devices, pipes and sockets, those are skipped by the default QDir filter too
+
+		QString entryName = QFile::decodeName( dirEntry->d_name );
+		QString origPath = dir % '/' % entryName;
+		QString entryPath = entryPrefix % entryName;
+
+		if (entryType == DT_LNK || entryType == DT_UNKNOWN)
+		{
+			// we need to know what the symlink points to, or the file system didn't tell us the type
+			QFileInfo origEntry( origPath );
+			entryType = origEntry.isDir() ? DT_DIR : origEntry.isFile() ? DT_REG : DT_UNKNOWN;
+		}
+
+		// broken symlinks are skipped, the same way the default QDir filter does
+		if (entryType == DT_DIR || entryType == DT_REG)
+		{
+			if (!visitEntry( origPath, QFileInfo( entryPath ), entryType == DT_DIR ))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+#else
 
+/// Lists a single directory, "." and ".." excluded. Returns false if the listing was cancelled or stopped by the visitor.
+static bool listDirectory(
+	const QString & dir, const QString & /*convertedDir*/, const PathConvertor & pathConvertor,
+	const ListedEntryVisitor & visitEntry, const std::atomic< bool > * cancelled
+)
+{
 	QDir dir_( dir );
 	if (!dir_.exists())
-		return;
+		return true;
 
 	QDirIterator dirIt( dir_ );
 	while (dirIt.hasNext())
 	{
+		if (cancelled && cancelled->load( std::memory_order_relaxed ))
+			return false;
+
 		QString entryPath = pathConvertor.convertPath( dirIt.next() );
 		QFileInfo entry( entryPath );
-		if (entry.isDir())
+		bool isDir = entry.isDir();
+		if (isDir)
 		{
 			QString dirName = dirIt.fileName();  // we need the original entry name including "." and "..", entry is already converted
-			if (dirName != "." && dirName != "..")
-			{
-				if (typesToVisit.isSet( EntryType::DIR ))
-					visitEntry( entry );
-				if (recursively)
-					traverseDirectory( entry.filePath(), recursively, typesToVisit, pathConvertor, visitEntry );
-			}
+			if (dirName == "." || dirName == "..")
+				continue;
+		}
+		if (!visitEntry( dirIt.filePath(), entry, isDir ))
+			return false;
+	}
+
+	return true;
+}
+
+#endif // !IS_WINDOWS
+
+static bool traverseDirectory_impl(
+	const QString & dir, const QString & convertedDir, bool recursively, EntryTypes typesToVisit,
+	const PathConvertor & pathConvertor, const std::function< void ( const QFileInfo & entry, bool isDir ) > & visitEntry,
+	const std::atomic< bool > * cancelled
+)
+{
+	return listDirectory( dir, convertedDir, pathConvertor, [&]( const QString & origPath, const QFileInfo & entry, bool isDir )
+	{
+		if (isDir)
+		{
+			if (typesToVisit.isSet( EntryType::DIR ))
+				visitEntry( entry, true );
+			if (recursively)
+				return traverseDirectory_impl( origPath, entry.filePath(), recursively, typesToVisit, pathConvertor, visitEntry, cancelled );
 		}
 		else
 		{
 			if (typesToVisit.isSet( EntryType::FILE ))
-				visitEntry( entry );
+				visitEntry( entry, false );
+		}
+		return true;
+	}, cancelled );
+}
+
+bool traverseDirectory(
+	const QString & dir, bool recursively, EntryTypes typesToVisit,
+	const PathConvertor & pathConvertor, const std::function< void ( const QFileInfo & entry, bool isDir ) > & visitEntry,
+	const std::atomic< bool > * cancelled
+)
+{
+	if (dir.isEmpty())
+		return true;
+
+	return traverseDirectory_impl( dir, pathConvertor.convertPath( dir ), recursively, typesToVisit, pathConvertor, visitEntry, cancelled );
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+
+namespace {
+
+struct ListedEntry
+{
+	QString name;  ///< cached, so that the sorting doesn't have to extract it on every comparison
+	QFileInfo entry;
+	QString origPath;
+	bool isDir;
+	size_t subdirIdx = 0;  ///< index of the listed content of this subdirectory, valid only for directories when recursing
+};
+
+struct ListedDir
+{
+	QString origPath;
+	QString convertedPath;
+	std::vector< ListedEntry > entries;  ///< sorted by name
+};
+
+} // namespace
+
+/// Visits the entries of an already listed directory tree in the order of a depth-first traversal.
+static void visitListedDir(
+	const std::deque< ListedDir > & listedDirs, size_t dirIdx, bool recursively, EntryTypes typesToVisit,
+	const std::function< void ( const QFileInfo & entry, bool isDir ) > & visitEntry
+)
+{
+	for (const ListedEntry & listedEntry : listedDirs[ dirIdx ].entries)
+	{
+		if (listedEntry.isDir)
+		{
+			if (typesToVisit.isSet( EntryType::DIR ))
+				visitEntry( listedEntry.entry, true );
+			if (recursively)
+				visitListedDir( listedDirs, listedEntry.subdirIdx, recursively, typesToVisit, visitEntry );
+		}
+		else
+		{
+			if (typesToVisit.isSet( EntryType::FILE ))
+				visitEntry( listedEntry.entry, false );
 		}
 	}
 }
 
+bool traverseDirectoryInParallel(
+	const QString & dir, bool recursively, EntryTypes typesToVisit,
+	const PathConvertor & pathConvertor, const std::function< void ( const QFileInfo & entry, bool isDir ) > & visitEntry,
+	const std::atomic< bool > * cancelled, QThreadPool * threadPool
+)
+{
+	if (dir.isEmpty())
+		return true;
+
+	// deque, because the already listed directories must stay in place while new ones are appended
+	std::deque< ListedDir > listedDirs;
+	listedDirs.push_back({ dir, pathConvertor.convertPath( dir ), {} });
+
+	// The tree is listed one level at a time. All the directories of a level are distributed among the threads,
+	// each thread takes the next unlisted directory as soon as it's done with its previous one, so that a single
+	// large directory doesn't hold back the others. The subdirectories found form the next level.
+	size_t levelBegin = 0;
+	while (levelBegin < listedDirs.size())
+	{
+		size_t levelEnd = listedDirs.size();
+
+		parallelFor( int( levelEnd - levelBegin ), [&]( int idx )
+		{
+			ListedDir & listedDir = listedDirs[ levelBegin + size_t( idx ) ];
+
+			listDirectory( listedDir.origPath, listedDir.convertedPath, pathConvertor,
+				[&]( const QString & origPath, const QFileInfo & entry, bool isDir )
+				{
+					listedDir.entries.push_back({ entry.fileName(), entry, origPath, isDir });
+					return true;
+				},
+				cancelled
+			);
+
+			// the order of the entries must not depend on the file system or on which thread listed what
+			std::sort( listedDir.entries.begin(), listedDir.entries.end(), []( const ListedEntry & e1, const ListedEntry & e2 )
+			{
+				return e1.name < e2.name;
+			});
+		}, threadPool );
+
+		if (cancelled && cancelled->load( std::memory_order_relaxed ))
+			return false;
+
+		if (!recursively)
+			break;
+
+		for (size_t dirIdx = levelBegin; dirIdx < levelEnd; ++dirIdx)
+		{
+			for (ListedEntry & listedEntry : listedDirs[ dirIdx ].entries)
+			{
+				if (listedEntry.isDir)
+				{
+					listedEntry.subdirIdx = listedDirs.size();
+					listedDirs.push_back({ listedEntry.origPath, listedEntry.entry.filePath(), {} });
+				}
+			}
+		}
+
+		levelBegin = levelEnd;
+	}
+
+	visitListedDir( listedDirs, 0, recursively, typesToVisit, visitEntry );
+
+	return true;
+}
 
 } // namespace fs
@@ -20,9 +20,11 @@ class PathConvertor;
 #include <QDir>
 #include <QFileInfo>
 class QModelIndex;
+class QThreadPool;
 
 #include <functional>
 #include <optional>
+#include <atomic>
 
 
 //======================================================================================================================
@@ -249,9 +251,24 @@ inline bool createDirIfDoesntExist( const QString & dirPath )
 
 //-- traversing directory content --------------------------------------------------------------------------------------
 
-void traverseDirectory(
+/// Calls visitEntry for every entry of the directory that is of one of the typesToVisit.
+/** The isDir argument tells the type of the entry known from the listing, so that the visitor doesn't have to query it.
+  * When the cancelled flag is given, it's checked for every entry and the traversal stops as soon as it's set,
+  * so that it can be aborted from another thread. Returns false if the traversal was cancelled. */
+bool traverseDirectory(
 	const QString & dir, bool recursively, EntryTypes typesToVisit,
-	const PathConvertor & pathConvertor, const std::function< void ( const QFileInfo & entry ) > & visitEntry
+	const PathConvertor & pathConvertor, const std::function< void ( const QFileInfo & entry, bool isDir ) > & visitEntry,
+	const std::atomic< bool > * cancelled = nullptr
+);
+
+/// Same as traverseDirectory(), but the subdirectories are listed in parallel by the threads of a thread pool.
+/** The global thread pool is used when threadPool is null. The entries are visited in the calling thread after the whole tree is listed, in a deterministic order:
+  * the entries of each directory sorted by name and each subdirectory followed by its own content.
+  * Meant for large directory trees, for a single directory it's no faster than traverseDirectory(). */
+bool traverseDirectoryInParallel(
+	const QString & dir, bool recursively, EntryTypes typesToVisit,
+	const PathConvertor & pathConvertor, const std::function< void ( const QFileInfo & entry, bool isDir ) > & visitEntry,
+	const std::atomic< bool > * cancelled = nullptr, QThreadPool * threadPool = nullptr
 );
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,44 @@
+//======================================================================================================================
+// Project: DoomRunner
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: stable non-cryptographic hash functions
+//======================================================================================================================
+
+#ifndef HASH_UTILS_INCLUDED
+#define HASH_UTILS_INCLUDED
+
+
+#include "Essential.hpp"
+
+#include <QStringView>
+
+#include <cstddef>  // size_t
+
+
+// Unlike qHash(), these hashes don't depend on a per-process random seed,
+// so they can be stored into files and compared across application runs.
+
+inline constexpr uint64_t fnv1aOffsetBasis = 14695981039346656037ull;
+inline constexpr uint64_t fnv1aPrime = 1099511628211ull;
+
+/// 64-bit FNV-1a hash of a byte sequence. Pass a previous result as the initial hash to continue hashing.
+inline uint64_t fnv1a64( const void * data, size_t size, uint64_t hash = fnv1aOffsetBasis )
+{
+	const uchar * bytes = static_cast< const uchar * >( data );
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= fnv1aPrime;
+	}
+	return hash;
+}
+
+/// Stable hash of a file path, hashes the UTF-16 code units directly without converting the string.
+inline uint64_t hashFilePath( QStringView filePath )
+{
+	return fnv1a64( filePath.data(), size_t( filePath.size() ) * sizeof(QChar) );
+}
+
+
+#endif // HASH_UTILS_INCLUDED
@@ -2,21 +2,71 @@
 // Project: DoomRunner
 //----------------------------------------------------------------------------------------------------------------------
 // Author:      Jan Broz (Youda008)
-// Description: information extracted from MAPINFO file either from a WAD or a PK3 file
+// Description: information extracted from map-definition lumps either from a WAD or a PK3 file
 //======================================================================================================================
 
 #include "MapInfo.hpp"
 
+#include "MapInfoTokenizer.hpp"
 #include "JsonUtils.hpp"
+#include "StringUtils.hpp"  // heapSize
 
-#include <QIODevice>
-#include <QTextStream>
-#include <QRegularExpression>
+#include <QDataStream>
+
+#include <algorithm>  // max
 
 
 namespace doom {
 
 
+//======================================================================================================================
+// MapInfo
+
+static int findMapDefIdx( const QList< MapDefinition > & mapDefs, const QString & mapName )
+{
+	for (qsize_t i = 0; i < mapDefs.size(); ++i)
+		if (mapDefs[i].name.compare( mapName, Qt::CaseInsensitive ) == 0)
+			return int( i );
+	return -1;
+}
+
+const MapDefinition * MapInfo::findMapDef( const QString & mapName ) const
+{
+	int idx = findMapDefIdx( mapDefs, mapName );
+	return idx >= 0 ? &mapDefs[ idx ] : nullptr;
+}
+
+void MapInfo::merge( const MapInfo & other )
+{
+	for (const QString & mapName : other.mapNames)
+		if (!mapNames.contains( mapName, Qt::CaseInsensitive ))
+			mapNames.append( mapName );
+
+	for (const MapDefinition & otherDef : other.mapDefs)
+	{
+		int idx = findMapDefIdx( mapDefs, otherDef.name );
+		if (idx < 0)
+		{
+			mapDefs.append( otherDef );
+			continue;
+		}
+		MapDefinition & mapDef = mapDefs[ idx ];
+		if (mapDef.title.isEmpty())
+			mapDef.title = otherDef.title;
+		if (mapDef.next.isEmpty())
+			mapDef.next = otherDef.next;
+		if (mapDef.secretNext.isEmpty())
+			mapDef.secretNext = otherDef.secretNext;
+	}
+
+	if (episodes.isEmpty())
+		episodes = other.episodes;
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+// serialization
+
 QJsonObject MapInfo::serialize() const
 {
 	QJsonObject jsMapInfo;
@@ -32,23 +82,521 @@ void MapInfo::deserialize( const JsonObjectCtx & jsMapInfo )
 		mapNames = deserializeStringList( jsMapNames );
 }
 
+void MapInfo::serialize( QDataStream & stream ) const
+{
+	stream << mapNames;
+
+	stream << quint32( mapDefs.size() );
+	for (const MapDefinition & mapDef : mapDefs)
+		stream << mapDef.name << mapDef.title << mapDef.next << mapDef.secretNext;
+
+	stream << quint32( episodes.size() );
+	for (const EpisodeDefinition & episode : episodes)
+		stream << episode.startMap << episode.name;
+}
+
+void MapInfo::deserialize( QDataStream & stream )
+{
+	stream >> mapNames;
+
+	// checking the stream status prevents a long loop when the count is damaged
+	quint32 mapDefCount = 0;
+	stream >> mapDefCount;
+	for (quint32 i = 0; i < mapDefCount && stream.status() == QDataStream::Ok; ++i)
+	{
+		MapDefinition mapDef;
+		stream >> mapDef.name >> mapDef.title >> mapDef.next >> mapDef.secretNext;
+		mapDefs.append( std::move(mapDef) );
+	}
+
+	quint32 episodeCount = 0;
+	stream >> episodeCount;
+	for (quint32 i = 0; i < episodeCount && stream.status() == QDataStream::Ok; ++i)
+	{
+		EpisodeDefinition episode;
+		stream >> episode.startMap >> episode.name;
+		episodes.append( std::move(episode) );
+	}
+}
+
+qint64 MapInfo::memoryUsage() const
+{
+	qint64 size = heapSize( mapNames );
+
+	size += qint64( mapDefs.capacity() ) * qint64( sizeof(MapDefinition) );
+	for (const MapDefinition & mapDef : mapDefs)
+		size += heapSize( mapDef.name ) + heapSize( mapDef.title ) + heapSize( mapDef.next ) + heapSize( mapDef.secretNext );
+
+	size += qint64( episodes.capacity() ) * qint64( sizeof(EpisodeDefinition) );
+	for (const EpisodeDefinition & episode : episodes)
+		size += heapSize( episode.startMap ) + heapSize( episode.name );
+
+	return size;
+}
+
+
+//======================================================================================================================
+// MAPINFO, ZMAPINFO and UMAPINFO parsing
+
+// https://zdoom.org/wiki/MAPINFO
+// https://zdoom.org/wiki/MAPINFO/Map_definition
+// https://zdoom.org/wiki/MAPINFO/Episode_definition
+// https://doomwiki.org/wiki/UMAPINFO
+//
+// The old syntax (MAPINFO) has the properties of a definition on the following lines without any braces:
+//     map MAP01 "Entryway"
+//     next MAP02
+// The new syntax (ZMAPINFO, UMAPINFO) has them in a block with assignments:
+//     map MAP01 lookup "HUSTR_1" { next = "MAP02" }
+//     MAP MAP01 { levelname = "Entryway"  episode = "M_EPI1", "Knee-Deep in the Dead", "K" }
+
+/// Keywords that start a top-level definition other than map or episode, so the properties that follow
+/// in the old syntax no longer belong to the previous map or episode.
+static const char * const otherDefinitionKeywords [] =
+{
+	"clusterdef", "defaultmap", "adddefaultmap", "gamedefaults", "gameinfo", "intermission",
+	"skill", "clearskills", "automap", "automap_overlay", "doomednums", "spawnnums",
+	"conversationids", "damagetype",
+};
 
-MapInfo parseMapInfo( const QByteArray & fileContent )
+/// Titles starting with '$' are references into the LANGUAGE lump, which we don't read.
+static QString titleFromToken( const MapInfoToken & token )
+{
+	if (token.size == 0 || token.data[0] == '$')
+		return {};
+	return token.toString();
+}
+
+namespace {
+
+class MapInfoParser {
+
+ public:
+
+	/// Called for every include directive, should apply the included content on top of the mapInfo.
+	using IncludeHandler = std::function< void ( const QString & includePath, MapInfo & mapInfo, bool & clearsEpisodes ) >;
+
+ private:
+
+	MapInfoTokenizer _tokenizer;
+	MapInfoToken _peekedToken;
+	bool _hasPeekedToken = false;
+
+	MapInfo & _mapInfo;
+	bool _clearsEpisodes = false;  ///< whether the content clears the episodes defined before it (in the includer)
+
+	IncludeHandler _onInclude;
+
+ public:
+
+	MapInfoParser( const QByteArray & content, MapInfo & mapInfo, IncludeHandler onInclude )
+		: _tokenizer( content ), _mapInfo( mapInfo ), _onInclude( std::move(onInclude) ) {}
+
+	void parse();
+
+	bool clearsEpisodes() const  { return _clearsEpisodes; }
+
+ private:
+
+	MapInfoToken next()
+	{
+		if (_hasPeekedToken)
+		{
+			_hasPeekedToken = false;
+			return _peekedToken;
+		}
+		return _tokenizer.next();
+	}
+
+	const MapInfoToken & peek()
+	{
+		if (!_hasPeekedToken)
+		{
+			_peekedToken = _tokenizer.next();
+			_hasPeekedToken = true;
+		}
+		return _peekedToken;
+	}
+
+	/// Reads the value of a property, the assignment is optional, because the old syntax doesn't have it.
+	MapInfoToken readValue()
+	{
+		if (peek().isSymbol('='))
+			next();
+		MapInfoToken value = peek();
+		if (value.type != MapInfoToken::Word && value.type != MapInfoToken::String)
+			return {};  // leave the symbol for the main loop, it might be a closing brace
+		return next();
+	}
+
+	/// Reads the next value of a comma-separated list of values, or returns End token if there is none.
+	MapInfoToken readNextListValue()
+	{
+		if (!peek().isSymbol(','))
+			return {};
+		next();
+		return readValue();
+	}
+
+	int addMap( const MapInfoToken & mapName );
+	int addEpisode( const MapInfoToken & startMap );
+
+	void readMapHeader( int mapIdx );
+	void readMapProperty( const MapInfoToken & key, int mapIdx );
+	void readEpisodeProperty( const MapInfoToken & key, int episodeIdx );
+
+};
+
+int MapInfoParser::addMap( const MapInfoToken & mapNameToken )
+{
+	QString mapName = mapNameToken.toString();
+
+	if (!_mapInfo.mapNames.contains( mapName, Qt::CaseInsensitive ))
+		_mapInfo.mapNames.append( mapName );
+
+	// a repeated definition replaces the previous one
+	int mapIdx = findMapDefIdx( _mapInfo.mapDefs, mapName );
+	if (mapIdx < 0)
+	{
+		mapIdx = int( _mapInfo.mapDefs.size() );
+		_mapInfo.mapDefs.append( MapDefinition() );
+	}
+	_mapInfo.mapDefs[ mapIdx ] = MapDefinition{ std::move(mapName), {}, {}, {} };
+	return mapIdx;
+}
+
+int MapInfoParser::addEpisode( const MapInfoToken & startMap )
+{
+	_mapInfo.episodes.append( EpisodeDefinition{ startMap.toString(), {} } );
+	return int( _mapInfo.episodes.size() - 1 );
+}
+
+void MapInfoParser::readMapHeader( int mapIdx )
+{
+	// map MAP01 "Title"  or  map MAP01 lookup "LANGUAGE_KEY"
+	if (peek().type == MapInfoToken::String)
+	{
+		_mapInfo.mapDefs[ mapIdx ].title = titleFromToken( next() );
+	}
+	else if (peek().isWord("lookup"))
+	{
+		next();
+		readValue();  // the title is in the LANGUAGE lump
+	}
+}
+
+void MapInfoParser::readMapProperty( const MapInfoToken & key, int mapIdx )
+{
+	MapDefinition & mapDef = _mapInfo.mapDefs[ mapIdx ];
+
+	if (key.isWord("next"))
+	{
+		mapDef.next = readValue().toString();
+	}
+	else if (key.isWord("secretnext") || key.isWord("nextsecret"))
+	{
+		mapDef.secretNext = readValue().toString();
+	}
+	else if (key.isWord("levelname"))  // UMAPINFO
+	{
+		mapDef.title = titleFromToken( readValue() );
+	}
+	else if (key.isWord("episode"))  // UMAPINFO: episode = patch, name, key  or  episode = clear
+	{
+		MapInfoToken patch = readValue();
+		if (patch.isWord("clear"))
+		{
+			_mapInfo.episodes.clear();
+			_clearsEpisodes = true;
+		}
+		else if (patch.type != MapInfoToken::End)
+		{
+			EpisodeDefinition episode;
+			episode.startMap = mapDef.name;
+			episode.name = titleFromToken( readNextListValue() );
+			_mapInfo.episodes.append( std::move(episode) );
+		}
+	}
+}
+
+void MapInfoParser::readEpisodeProperty( const MapInfoToken & key, int episodeIdx )
+{
+	if (key.isWord("name"))
+	{
+		_mapInfo.episodes[ episodeIdx ].name = titleFromToken( readValue() );
+	}
+}
+
+void MapInfoParser::parse()
+{
+	enum class Definition
+	{
+		None,
+		Map,
+		Episode,
+	};
+
+	Definition currentDef = Definition::None;   // the definition the following properties belong to
+	int currentIdx = -1;                         // index of the current definition in its list
+	int braceDepth = 0;
+	MapInfoToken prevToken;
+
+	for (MapInfoToken token = next(); token.type != MapInfoToken::End; prevToken = token, token = next())
+	{
+		if (token.isSymbol('{'))
+		{
+			++braceDepth;
+			continue;
+		}
+		else if (token.isSymbol('}'))
+		{
+			braceDepth = std::max( braceDepth - 1, 0 );
+			if (braceDepth == 0)
+				currentDef = Definition::None;  // the block of the definition ended
+			continue;
+		}
+		else if (token.type != MapInfoToken::Word)
+		{
+			continue;  // values of properties we are not interested in
+		}
+
+		bool isValue = prevToken.isSymbol('=') || prevToken.isSymbol(',');
+
+		if (braceDepth == 0 && !isValue && token.isWord("map"))
+		{
+			MapInfoToken mapName = peek();
+			if ((mapName.type == MapInfoToken::Word || mapName.type == MapInfoToken::String) && mapName.size > 0)
+			{
+				next();
+				currentDef = Definition::Map;
+				currentIdx = addMap( mapName );
+				readMapHeader( currentIdx );
+			}
+			else
+			{
+				currentDef = Definition::None;
+			}
+		}
+		else if (braceDepth == 0 && !isValue && token.isWord("episode"))
+		{
+			MapInfoToken startMap = peek();
+			if ((startMap.type == MapInfoToken::Word || startMap.type == MapInfoToken::String) && startMap.size > 0)
+			{
+				next();
+				currentDef = Definition::Episode;
+				currentIdx = addEpisode( startMap );
+			}
+			else
+			{
+				currentDef = Definition::None;
+			}
+		}
+		else if (braceDepth == 0 && !isValue && token.isWord("clearepisodes"))
+		{
+			_mapInfo.episodes.clear();
+			_clearsEpisodes = true;
+			currentDef = Definition::None;
+		}
+		else if (braceDepth == 0 && !isValue && token.isWord("include"))
+		{
+			MapInfoToken includePath = peek();
+			if ((includePath.type == MapInfoToken::Word || includePath.type == MapInfoToken::String) && includePath.size > 0)
+			{
+				next();
+				_onInclude( includePath.toString(), _mapInfo, _clearsEpisodes );
+			}
+			currentDef = Definition::None;
+		}
+		else if (braceDepth == 0 && !isValue && token.isWord("cluster"))
+		{
+			// The new syntax defines a cluster with a block:  cluster 1 { ... }
+			// while in the old syntax it's a property of the map  (the definition is clusterdef there).
+			const MapInfoToken & clusterNum = peek();
+			if (clusterNum.type == MapInfoToken::Word || clusterNum.type == MapInfoToken::String)
+				next();
+			if (peek().isSymbol('{'))
+				currentDef = Definition::None;
+		}
+		else if (braceDepth == 0 && !isValue && std::any_of( std::begin(otherDefinitionKeywords), std::end(otherDefinitionKeywords),
+		                                                     [ &token ]( const char * keyword ) { return token.isWord( keyword ); } ))
+		{
+			currentDef = Definition::None;
+		}
+		else if (braceDepth <= 1 && currentDef == Definition::Map)  // old syntax at depth 0, new syntax at depth 1
+		{
+			readMapProperty( token, currentIdx );
+		}
+		else if (braceDepth <= 1 && currentDef == Definition::Episode)
+		{
+			readEpisodeProperty( token, currentIdx );
+		}
+	}
+}
+
+} // namespace
+
+
+//======================================================================================================================
+// include resolution
+
+/// Include paths are compared case-insensitively, the same way the engines look up the lumps and PK3 entries.
+static QString normalizeIncludePath( const QString & includePath )
+{
+	QString normPath = includePath.toLower();
+	normPath.replace( '\\', '/' );
+	return normPath;
+}
+
+/// Applies the content of an included lump on top of the definitions parsed before the include directive,
+/// as if the included text was written in place of the directive.
+static void applyIncludedMapInfo( MapInfo & mapInfo, const MapInfo & included, bool includedClearsEpisodes )
+{
+	for (const QString & mapName : included.mapNames)
+		if (!mapInfo.mapNames.contains( mapName, Qt::CaseInsensitive ))
+			mapInfo.mapNames.append( mapName );
+
+	// a repeated definition replaces the previous one
+	for (const MapDefinition & mapDef : included.mapDefs)
+	{
+		int idx = findMapDefIdx( mapInfo.mapDefs, mapDef.name );
+		if (idx >= 0)
+			mapInfo.mapDefs[ idx ] = mapDef;
+		else
+			mapInfo.mapDefs.append( mapDef );
+	}
+
+	if (includedClearsEpisodes)
+		mapInfo.episodes.clear();
+	for (const EpisodeDefinition & episode : included.episodes)
+		mapInfo.episodes.append( episode );
+}
+
+MapInfo MapInfoReader::parseMapInfo( const QByteArray & fileContent, const QString & lumpName )
 {
 	MapInfo mapInfo;
 
-	QTextStream fileText( fileContent, QIODevice::ReadOnly );
+	parseLump( fileContent, normalizeIncludePath( lumpName ), mapInfo );
+
+	return mapInfo;
+}
+
+bool MapInfoReader::parseLump( const QByteArray & content, const QString & normPath, MapInfo & mapInfo )
+{
+	_includeStack.append( normPath );
 
-	static const QRegularExpression mapDefRegex("^\\s*map\\s+(\\w+)(?:\\s+\"([^\"]*)\")?");
+	MapInfoParser parser( content, mapInfo, [ this ]( const QString & includePath, MapInfo & includerMapInfo, bool & clearsEpisodes )
+	{
+		includeLump( includePath, includerMapInfo, clearsEpisodes );
+	});
+	parser.parse();
+
+	_includeStack.removeLast();
+
+	return parser.clearsEpisodes();
+}
 
-	QString line;
-	while (fileText.readLineInto( &line ))
+void MapInfoReader::includeLump( const QString & includePath, MapInfo & mapInfo, bool & clearsEpisodes )
+{
+	QString normPath = normalizeIncludePath( includePath );
+
+	if (_includeStack.contains( normPath ))
+	{
+		logRuntimeError() << "include cycle in "<<_filePath<<": "<<_includeStack.join(" -> ")<<" -> "<<normPath;
+		return;
+	}
+
+	auto parsedIter = _parsedIncludes.find( normPath );
+	if (parsedIter == _parsedIncludes.end())
 	{
-		auto match = mapDefRegex.match( line );
-		if (match.hasMatch())
+		std::optional< QByteArray > includedContent = _loadInclude ? _loadInclude( normPath ) : std::nullopt;
+		if (!includedContent)
 		{
-			mapInfo.mapNames.append( match.captured(1) );
+			logRuntimeError() << "lump "<<includePath<<" included from "<<_filePath<<" was not found";
+			// remember it too, so that the next include of the same lump doesn't search for it again
+			_includeClearsEpisodes.insert( normPath, false );
+			parsedIter = _parsedIncludes.insert( normPath, MapInfo() );
 		}
+		else
+		{
+			MapInfo includedMapInfo;
+			bool includedClearsEpisodes = parseLump( *includedContent, normPath, includedMapInfo );
+
+			_includeClearsEpisodes.insert( normPath, includedClearsEpisodes );
+			parsedIter = _parsedIncludes.insert( normPath, std::move(includedMapInfo) );
+		}
+	}
+
+	bool includedClearsEpisodes = _includeClearsEpisodes.value( normPath, false );
+	applyIncludedMapInfo( mapInfo, parsedIter.value(), includedClearsEpisodes );
+	if (includedClearsEpisodes)
+		clearsEpisodes = true;
+}
+
+
+//======================================================================================================================
+// EMAPINFO parsing
+
+// https://eternity.youfailit.net/wiki/EMAPINFO
+//
+// It's an ini-like format with one section per map:
+//     [MAP01]
+//     levelname = Entryway
+//     nextlevel = MAP02
+
+MapInfo parseEMapInfo( const QByteArray & fileContent )
+{
+	MapInfo mapInfo;
+
+	int mapIdx = -1;
+
+	qsize_t lineStart = 0;
+	while (lineStart < fileContent.size())
+	{
+		qsize_t lineEnd = fileContent.indexOf( '\n', lineStart );
+		if (lineEnd < 0)
+			lineEnd = fileContent.size();
+		const QByteArray line = fileContent.mid( lineStart, lineEnd - lineStart ).trimmed();
+		lineStart = lineEnd + 1;
+
+		if (line.isEmpty() || line.startsWith(';') || line.startsWith('#') || line.startsWith("//"))
+		{
+			continue;
+		}
+
+		if (line.startsWith('[') && line.endsWith(']'))
+		{
+			QString mapName = QString::fromUtf8( line.mid( 1, line.size() - 2 ).trimmed() );
+			if (mapName.isEmpty())
+			{
+				mapIdx = -1;
+				continue;
+			}
+			if (!mapInfo.mapNames.contains( mapName, Qt::CaseInsensitive ))
+				mapInfo.mapNames.append( mapName );
+			mapIdx = findMapDefIdx( mapInfo.mapDefs, mapName );
+			if (mapIdx < 0)
+			{
+				mapIdx = int( mapInfo.mapDefs.size() );
+				mapInfo.mapDefs.append( MapDefinition{ std::move(mapName), {}, {}, {} } );
+			}
+			continue;
+		}
+
+		qsize_t separatorPos = line.indexOf('=');
+		if (mapIdx < 0 || separatorPos < 0)
+		{
+			continue;
+		}
+		const QByteArray key = line.left( separatorPos ).trimmed().toLower();
+		const QString value = QString::fromUtf8( line.mid( separatorPos + 1 ).trimmed() );
+
+		MapDefinition & mapDef = mapInfo.mapDefs[ mapIdx ];
+		if (key == "levelname")
+			mapDef.title = value;
+		else if (key == "nextlevel")
+			mapDef.next = value;
+		else if (key == "nextsecret")
+			mapDef.secretNext = value;
 	}
 
 	return mapInfo;
@@ -2,7 +2,7 @@
 // Project: DoomRunner
 //----------------------------------------------------------------------------------------------------------------------
 // Author:      Jan Broz (Youda008)
-// Description: information extracted from MAPINFO file either from a WAD or a PK3 file
+// Description: information extracted from map-definition lumps either from a WAD or a PK3 file
 //======================================================================================================================
 
 #ifndef MAPINFO_INCLUDED
@@ -11,26 +11,105 @@
 
 #include "Essential.hpp"
 
+#include "ErrorHandling.hpp"  // LoggingComponent
+
+#include <QString>
 #include <QStringList>
+#include <QList>
+#include <QHash>
+
+#include <functional>
+#include <optional>
 
 class QJsonObject;
 class JsonObjectCtx;
 class QByteArray;
+class QDataStream;
 
 
 namespace doom {
 
 
+/// Details of one map defined in a map-definition lump.
+struct MapDefinition
+{
+	QString name;         ///< lump name usable for the +map command
+	QString title;        ///< human-readable title, empty when it's not defined or it's only a reference to LANGUAGE lump
+	QString next;         ///< map that follows after the normal exit, empty when not defined
+	QString secretNext;   ///< map that follows after the secret exit, empty when not defined
+};
+
+/// One entry of the episode selection menu.
+struct EpisodeDefinition
+{
+	QString startMap;     ///< map the episode starts with
+	QString name;         ///< name displayed in the menu, empty when it's only a reference to LANGUAGE lump
+};
+
+/// Information extracted from the map-definition lumps (MAPINFO, ZMAPINFO, UMAPINFO, EMAPINFO).
 struct MapInfo
 {
-	QStringList mapNames;   ///< list of map names usable for the +map command
+	QStringList mapNames;                   ///< list of map names usable for the +map command
+	QList< MapDefinition > mapDefs;         ///< details of those maps that are defined in a map-definition lump
+	QList< EpisodeDefinition > episodes;    ///< episodes in the order of the episode menu
+
+	/// Returns the definition of a map with this name, or nullptr if the map has no definition.
+	const MapDefinition * findMapDef( const QString & mapName ) const;
+
+	/// Adds the maps and episodes that are not defined here yet from a less preferred map-definition lump.
+	/** Fields that are already defined are kept, empty fields of existing maps are filled in. */
+	void merge( const MapInfo & other );
 
 	QJsonObject serialize() const;
 	void deserialize( const JsonObjectCtx & jsWadInfo );
+
+	void serialize( QDataStream & stream ) const;
+	void deserialize( QDataStream & stream );
+
+	/// Approximate number of bytes allocated on the heap, used for the cache size accounting.
+	qint64 memoryUsage() const;
 };
 
 
-MapInfo parseMapInfo( const QByteArray & fileContent );
+/// Parses the content of an EMAPINFO lump of the Eternity engine.
+MapInfo parseEMapInfo( const QByteArray & fileContent );
+
+
+/// Returns the content of a lump or a file referenced by an include directive, or nothing when it doesn't exist.
+using MapInfoIncludeLoader = std::function< std::optional< QByteArray > ( const QString & includePath ) >;
+
+//======================================================================================================================
+/// Parses the map-definition lumps of one WAD or PK3 file and resolves the include directives among its lumps.
+/** Each included lump is parsed only once and its result is reused when it's included again from another place,
+  * so the same reader should be used for all the map-definition lumps of the file. */
+
+class MapInfoReader : protected LoggingComponent {
+
+	QString _filePath;  ///< WAD or PK3 file the lumps come from, for the log messages
+	MapInfoIncludeLoader _loadInclude;
+
+	QHash< QString, MapInfo > _parsedIncludes;     ///< normalized include path -> its parsed content
+	QHash< QString, bool > _includeClearsEpisodes;  ///< normalized include path -> whether it clears the previous episodes
+	QStringList _includeStack;                      ///< lumps that are being parsed right now, to detect cycles
+
+ public:
+
+	MapInfoReader( QString filePath, MapInfoIncludeLoader loadInclude )
+		: LoggingComponent( u"MapInfoReader" ), _filePath( std::move(filePath) ), _loadInclude( std::move(loadInclude) ) {}
+
+	/// Parses the content of a MAPINFO, ZMAPINFO or UMAPINFO lump and everything it includes.
+	/** The lumpName is used to detect when the lump includes itself. */
+	MapInfo parseMapInfo( const QByteArray & fileContent, const QString & lumpName );
+
+ private:
+
+	/// Parses one lump into the mapInfo, returns whether it clears the episodes defined before it.
+	bool parseLump( const QByteArray & content, const QString & normPath, MapInfo & mapInfo );
+
+	/// Applies the content of the included lump on top of the definitions parsed so far.
+	void includeLump( const QString & includePath, MapInfo & mapInfo, bool & clearsEpisodes );
+
+};
 
 
 } // namespace doom
@@ -0,0 +1,112 @@
+//======================================================================================================================
+// Project: DoomRunner
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: tokenizer of MAPINFO-like lumps
+//======================================================================================================================
+
+#include "MapInfoTokenizer.hpp"
+
+
+namespace doom {
+
+
+// https://zdoom.org/wiki/MAPINFO
+// https://doomwiki.org/wiki/UMAPINFO
+
+// The character tests are intentionally written without <cctype>, so that they don't depend on the C locale.
+
+static inline bool isSpace( char c )
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static inline bool isSymbol( char c )
+{
+	return c == '{' || c == '}' || c == '=' || c == ',';
+}
+
+static inline char toLowerAscii( char c )
+{
+	return c >= 'A' && c <= 'Z' ? char( c - 'A' + 'a' ) : c;
+}
+
+bool MapInfoToken::isWord( const char * keyword ) const
+{
+	if (type != Word)
+		return false;
+	for (qsize_t i = 0; i < size; ++i)
+		if (keyword[i] == '\0' || toLowerAscii( data[i] ) != keyword[i])
+			return false;
+	return keyword[ size ] == '\0';
+}
+
+void MapInfoTokenizer::skipWhitespaceAndComments()
+{
+	while (_pos < _end)
+	{
+		if (isSpace( *_pos ))
+		{
+			++_pos;
+		}
+		else if (*_pos == ';' || (*_pos == '/' && _pos + 1 < _end && _pos[1] == '/'))  // line comment
+		{
+			while (_pos < _end && *_pos != '\n')
+				++_pos;
+		}
+		else if (*_pos == '/' && _pos + 1 < _end && _pos[1] == '*')  // block comment
+		{
+			_pos += 2;
+			while (_pos < _end && !(*_pos == '*' && _pos + 1 < _end && _pos[1] == '/'))
+				++_pos;
+			_pos = _pos < _end ? _pos + 2 : _end;
+		}
+		else
+		{
+			break;
+		}
+	}
+}
+
+MapInfoToken MapInfoTokenizer::next()
+{
+	skipWhitespaceAndComments();
+
+	MapInfoToken token;
+	if (_pos >= _end)
+	{
+		return token;
+	}
+
+	if (isSymbol( *_pos ))
+	{
+		token.type = MapInfoToken::Symbol;
+		token.data = _pos;
+		token.size = 1;
+		++_pos;
+	}
+	else if (*_pos == '"')
+	{
+		token.type = MapInfoToken::String;
+		token.data = ++_pos;
+		while (_pos < _end && *_pos != '"')
+			_pos += (*_pos == '\\' && _pos + 1 < _end) ? 2 : 1;  // escaped quote doesn't end the string
+		token.size = qsize_t( _pos - token.data );
+		if (_pos < _end)
+			++_pos;  // the closing quote
+	}
+	else
+	{
+		token.type = MapInfoToken::Word;
+		token.data = _pos;
+		while (_pos < _end && !isSpace( *_pos ) && !isSymbol( *_pos ) && *_pos != '"' && *_pos != ';'
+		    && !(*_pos == '/' && _pos + 1 < _end && (_pos[1] == '/' || _pos[1] == '*')))
+			++_pos;
+		token.size = qsize_t( _pos - token.data );
+	}
+
+	return token;
+}
+
+
+} // namespace doom
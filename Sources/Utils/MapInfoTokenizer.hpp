@@ -0,0 +1,79 @@
+//======================================================================================================================
+// Project: DoomRunner
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: tokenizer of MAPINFO-like lumps
+//======================================================================================================================
+
+#ifndef MAPINFO_TOKENIZER_INCLUDED
+#define MAPINFO_TOKENIZER_INCLUDED
+
+
+#include "Essential.hpp"
+
+#include "CommonTypes.hpp"  // qsize_t
+
+#include <QString>
+#include <QByteArray>
+
+
+namespace doom {
+
+
+//======================================================================================================================
+/// One token of a MAPINFO-like lump. Points directly into the lump content, nothing is copied.
+
+struct MapInfoToken
+{
+	enum Type
+	{
+		End,      ///< there are no more tokens
+		Word,     ///< keyword, identifier or number
+		String,   ///< text in double quotes, the quotes are not part of the token and escape sequences are kept as they are
+		Symbol,   ///< one of { } = ,
+	};
+
+	Type type = End;
+	const char * data = nullptr;
+	qsize_t size = 0;
+
+	bool isSymbol( char symbol ) const  { return type == Symbol && data[0] == symbol; }
+
+	/// Whether it's a Word equal to the keyword, ignoring case. The keyword must be lower-case ASCII.
+	bool isWord( const char * keyword ) const;
+
+	/// Converts the token text to a string. Should be done only for the tokens that are actually stored somewhere.
+	QString toString() const  { return QString::fromUtf8( data, size ); }
+};
+
+
+//======================================================================================================================
+/// Splits the content of MAPINFO-like lumps into tokens in a single pass over the raw bytes.
+/** Handles the old Hexen-style MAPINFO as well as the ZMAPINFO and UMAPINFO syntax with braces.
+  * Whitespace, line comments (// and ;) and block comments are skipped, strings can span multiple lines.
+  * The content must outlive the tokenizer and the tokens. */
+
+class MapInfoTokenizer {
+
+	const char * _pos;
+	const char * _end;
+
+ public:
+
+	MapInfoTokenizer( const QByteArray & content )
+		: _pos( content.constData() ), _end( content.constData() + content.size() ) {}
+
+	/// Returns the next token or a token of type End when the content is exhausted.
+	MapInfoToken next();
+
+ private:
+
+	void skipWhitespaceAndComments();
+
+};
+
+
+} // namespace doom
+
+
+#endif // MAPINFO_TOKENIZER_INCLUDED
@@ -0,0 +1,52 @@
+//======================================================================================================================
+// Project: DoomRunner
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: read-only memory-mapped file
+//======================================================================================================================
+
+#include "MappedFile.hpp"
+
+
+namespace fs {
+
+
+ReadStatus MappedFile::open( const QString & filePath )
+{
+	close();
+
+	_file.setFileName( filePath );
+	if (!_file.open( QIODevice::ReadOnly ))
+	{
+		return ReadStatus::CantOpen;
+	}
+
+	qint64 fileSize = _file.size();
+	if (fileSize <= 0)
+	{
+		return ReadStatus::Success;  // there is nothing to map, the callers must check the size anyway
+	}
+
+	_data = _file.map( 0, fileSize );
+	if (!_data)
+	{
+		return ReadStatus::FailedToRead;
+	}
+	_size = fileSize;
+
+	return ReadStatus::Success;
+}
+
+void MappedFile::close()
+{
+	if (_data)
+	{
+		_file.unmap( const_cast< uchar * >( _data ) );
+		_data = nullptr;
+	}
+	_size = 0;
+	_file.close();
+}
+
+
+} // namespace fs
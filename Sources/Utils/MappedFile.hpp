@@ -0,0 +1,74 @@
+//======================================================================================================================
+// Project: DoomRunner
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: read-only memory-mapped file
+//======================================================================================================================
+
+#ifndef MAPPED_FILE_INCLUDED
+#define MAPPED_FILE_INCLUDED
+
+
+#include "Essential.hpp"
+
+#include "FileInfoCacheTypes.hpp"  // ReadStatus
+
+#include <QString>
+#include <QFile>
+
+
+namespace fs {
+
+
+//======================================================================================================================
+/// Read-only view of a whole file mapped into memory.
+/** Allows parsers to walk the file content in place without copying it into heap buffers.
+  * The content pointers are valid only until the file is closed or this object is destroyed. */
+
+class MappedFile {
+
+	QFile _file;
+	const uchar * _data = nullptr;
+	qint64 _size = 0;
+
+ public:
+
+	MappedFile() = default;
+	~MappedFile()  { close(); }
+
+	MappedFile( const MappedFile & other ) = delete;
+	MappedFile & operator=( const MappedFile & other ) = delete;
+
+	/// Opens the file and maps its whole content into memory.
+	/** Returns CantOpen when the file cannot be opened and FailedToRead when the content cannot be mapped.
+	  * An empty file is opened successfully, but data() will be null. */
+	ReadStatus open( const QString & filePath );
+
+	void close();
+
+	bool isOpen() const                 { return _file.isOpen(); }
+	QString fileName() const            { return _file.fileName(); }
+	QString errorString() const         { return _file.errorString(); }
+
+	const uchar * data() const          { return _data; }
+	qint64 size() const                 { return _size; }
+
+	/// Whether the range <offset, offset + length) lies within the file.
+	bool containsRange( qint64 offset, qint64 length ) const
+	{
+		return offset >= 0 && length >= 0 && offset <= _size && length <= _size - offset;
+	}
+
+	/// Returns a pointer to the content at offset, or nullptr if the range is not within the file.
+	const uchar * dataAt( qint64 offset, qint64 length ) const
+	{
+		return containsRange( offset, length ) ? _data + offset : nullptr;
+	}
+
+};
+
+
+} // namespace fs
+
+
+#endif // MAPPED_FILE_INCLUDED
@@ -8,6 +8,12 @@
 #include "Pk3Reader.hpp"
 
 #include "ZipReader.hpp"
+#include "WADReader.hpp"        // readWadInfoInsideZip
+#include "JsonUtils.hpp"
+#include "StringUtils.hpp"      // heapSize
+
+#include <QDataStream>
+#include <QTextStream>
 
 
 namespace doom {
@@ -28,6 +34,124 @@ void Pk3Info::deserialize( const JsonObjectCtx & jsPk3Info )
 }
 
 
+//======================================================================================================================
+// binary serialization
+
+void Pk3Info::serialize( QDataStream & stream ) const
+{
+	mapInfo.serialize( stream );
+	stream << gameInfo.iwad << gameInfo.load << gameInfo.startupTitle;
+	stream << mapWads << embeddedWads;
+	stream << QString( game.gzdoomID );  // the pointers must be restored from the table of known games
+}
+
+void Pk3Info::deserialize( QDataStream & stream )
+{
+	mapInfo.deserialize( stream );
+	stream >> gameInfo.iwad >> gameInfo.load >> gameInfo.startupTitle;
+	QString gameID;
+	stream >> mapWads >> embeddedWads;
+	stream >> gameID;
+	game = findGameByID( gameID );
+}
+
+qint64 Pk3Info::memoryUsage() const
+{
+	return mapInfo.memoryUsage()
+	     + heapSize( gameInfo.iwad ) + heapSize( gameInfo.load ) + heapSize( gameInfo.startupTitle )
+	     + heapSize( mapWads ) + heapSize( embeddedWads );  // the game identification points to static strings
+}
+
+
+//======================================================================================================================
+// GAMEINFO parsing
+
+// https://zdoom.org/wiki/GAMEINFO
+
+static QString unquoted( const QString & value )
+{
+	QString trimmed = value.trimmed();
+	if (trimmed.size() >= 2 && trimmed.startsWith('"') && trimmed.endsWith('"'))
+		return trimmed.mid( 1, trimmed.size() - 2 );
+	return trimmed;
+}
+
+static GameInfo parseGameInfo( const QByteArray & fileContent )
+{
+	GameInfo gameInfo;
+
+	QTextStream fileText( fileContent, QIODevice::ReadOnly );
+
+	QString line;
+	while (fileText.readLineInto( &line ))
+	{
+		auto commentStart = line.indexOf( "//" );
+		if (commentStart >= 0)
+			line.truncate( commentStart );
+
+		auto separatorPos = line.indexOf('=');
+		if (separatorPos < 0)
+			continue;
+
+		QString key = line.left( separatorPos ).trimmed().toUpper();
+		QString values = line.mid( separatorPos + 1 );
+
+		if (key == "IWAD")
+		{
+			gameInfo.iwad = unquoted( values );
+		}
+		else if (key == "LOAD")
+		{
+			for (const QString & value : values.split(','))
+			{
+				QString fileName = unquoted( value );
+				if (!fileName.isEmpty())
+					gameInfo.load.append( std::move(fileName) );
+			}
+		}
+		else if (key == "STARTUPTITLE")
+		{
+			gameInfo.startupTitle = unquoted( values );
+		}
+	}
+
+	return gameInfo;
+}
+
+
+//======================================================================================================================
+// map names from the maps/ directory
+
+// https://zdoom.org/wiki/Using_ZIPs_as_WAD_replacement
+
+/// Returns the name of the map stored in this entry of the maps/ directory, or empty string if it's not a map.
+static QString getMapNameFromMapWad( const QString & entryPath )
+{
+	// the map name is the file name without the suffix
+	auto nameStart = entryPath.lastIndexOf('/') + 1;
+	auto nameEnd = entryPath.lastIndexOf('.');
+	if (nameEnd <= nameStart)
+		return {};
+	QString mapName = entryPath.mid( nameStart, nameEnd - nameStart ).toUpper();
+
+	// it must be usable as a lump name, otherwise it can't be started with the +map command
+	if (mapName.size() > 8)
+		return {};
+	for (QChar c : mapName)
+	{
+		bool isLumpNameChar = (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '-';
+		if (!isLumpNameChar)
+			return {};
+	}
+
+	// the title map is displayed behind the main menu, it's not a playable level
+	if (mapName == "TITLEMAP")
+		return {};
+
+	return mapName;
+}
+
+
 //======================================================================================================================
 // public API
 
@@ -35,16 +159,113 @@ UncertainPk3Info readPk3Info( const QString & filePath )
 {
 	UncertainPk3Info pk3Info;
 
-	auto mapInfoContent = readOneOfFilesInsideZip( filePath, { "MAPINFO", "MAPINFO.txt" } );
-	if (!mapInfoContent)
+	// everything we want to know about the pk3 is requested at once, so that the file is opened only once
+	enum WantedFile
 	{
-		pk3Info.status = mapInfoContent.error();
+		ZMapInfoFile,
+		MapInfoFile,
+		UMapInfoFile,
+		EMapInfoFile,
+		GameInfoFile,
+	};
+	ZipExtractionRequest request;
+	request.files = {
+		{ "ZMAPINFO", "ZMAPINFO.txt" },
+		{ "MAPINFO", "MAPINFO.txt" },
+		{ "UMAPINFO", "UMAPINFO.txt" },
+		{ "EMAPINFO", "EMAPINFO.txt" },
+		{ "GAMEINFO", "GAMEINFO.txt" },
+	};
+	request.listedDirs = { "maps/", "" };  // the root directory is for embedded WADs
+	request.listedSuffixes = { ".wad" };
+
+	ZipEntryReader zipReader;
+	ReadStatus openStatus = zipReader.openZip( filePath );
+	if (openStatus != ReadStatus::Success)
+	{
+		pk3Info.status = openStatus;
+		return pk3Info;
+	}
+
+	auto zipContent = readFilesInsideZip( zipReader, request );
+	if (!zipContent)
+	{
+		pk3Info.status = zipContent.error();
 		return pk3Info;
 	}
+	const QList< UncertainFileContent > & files = zipContent->files;
 
-	pk3Info.mapInfo = doom::parseMapInfo( *mapInfoContent );
+	for (QString & listedWad : zipContent->listedEntries)
+	{
+		if (listedWad.contains('/'))
+			pk3Info.mapWads.append( std::move(listedWad) );
+		else
+			pk3Info.embeddedWads.append( std::move(listedWad) );
+	}
+
+	// merge all the map definition files, when a map is defined in several of them,
+	// the one preferred by the engines takes precedence
+	doom::MapInfoReader mapInfoReader( filePath, [ &zipReader ]( const QString & includePath ) -> std::optional< QByteArray >
+	{
+		// the includes refer to files by their full path inside the pk3
+		int entryIdx = zipReader.index().findEntry( includePath );
+		if (entryIdx == ZipEntryIndex::NotFound || zipReader.openEntry( zipReader.index().entry( entryIdx ) ) != ReadStatus::Success)
+			return std::nullopt;
+		UncertainFileContent includedContent = zipReader.readAll();
+		if (!includedContent)
+			return std::nullopt;
+		return std::move( *includedContent );
+	});
+	for (WantedFile mapDefFile : { ZMapInfoFile, MapInfoFile, UMapInfoFile, EMapInfoFile })
+	{
+		if (files[ mapDefFile ])
+		{
+			const QByteArray & fileContent = *files[ mapDefFile ];
+			pk3Info.mapInfo.merge(
+				mapDefFile == EMapInfoFile ? doom::parseEMapInfo( fileContent )
+				                           : mapInfoReader.parseMapInfo( fileContent, request.files[ mapDefFile ][0] )
+			);
+		}
+	}
+
+	// many map packs don't have any MAPINFO and simply store the maps as WADs in the maps/ directory,
+	// their names are known from the zip directory alone without decompressing anything
+	if (pk3Info.mapInfo.mapNames.isEmpty())
+	{
+		for (const QString & mapWad : pk3Info.mapWads)
+		{
+			QString mapName = getMapNameFromMapWad( mapWad );
+			if (!mapName.isEmpty())
+				pk3Info.mapInfo.mapNames.append( std::move(mapName) );
+		}
+	}
+
+	if (files[ GameInfoFile ])
+	{
+		pk3Info.gameInfo = parseGameInfo( *files[ GameInfoFile ] );
+	}
+
+	// The embedded WADs are loaded by the engines together with the pk3, so their maps are available too.
+	// Only their header and lump directory are needed, which can be streamed without extracting the whole WAD.
+	for (const QString & embeddedWad : pk3Info.embeddedWads)
+	{
+		int entryIdx = zipReader.index().findEntry( embeddedWad );
+		if (entryIdx == ZipEntryIndex::NotFound || zipReader.openEntry( zipReader.index().entry( entryIdx ) ) != ReadStatus::Success)
+			continue;
+
+		UncertainWadInfo wadInfo = readWadInfoInsideZip( zipReader );
+		if (wadInfo.status != ReadStatus::Success)
+			continue;
+
+		pk3Info.mapInfo.merge( wadInfo.mapInfo );
+
+		if (wadInfo.type == WadType::IWAD && !pk3Info.game.gzdoomID)
+			pk3Info.game = wadInfo.game;
+	}
 
-	pk3Info.status = !pk3Info.mapInfo.mapNames.isEmpty() ? ReadStatus::Success : ReadStatus::InfoNotPresent;
+	bool anythingFound = !pk3Info.mapInfo.mapNames.isEmpty() || !pk3Info.gameInfo.isEmpty()
+	                  || !pk3Info.mapWads.isEmpty() || !pk3Info.embeddedWads.isEmpty();
+	pk3Info.status = anythingFound ? ReadStatus::Success : ReadStatus::InfoNotPresent;
 	return pk3Info;
 }
 
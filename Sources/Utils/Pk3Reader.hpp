@@ -11,32 +11,57 @@
 
 #include "Essential.hpp"
 
+#include "DoomFiles.hpp"  // GameIdentification
 #include "MapInfo.hpp"  // MapInfo
 #include "FileInfoCache.hpp"
 
 #include <QString>
+#include <QStringList>
 
 
 class QJsonObject;
 class JsonObjectCtx;
+class QDataStream;
 
 
 
 namespace doom {
 
 
+/// Content of a GAMEINFO file, tells the engine how the mod should be loaded.
+struct GameInfo
+{
+	QString iwad;           ///< IWAD the mod is designed for
+	QStringList load;       ///< additional files the mod loads
+	QString startupTitle;   ///< title displayed by the engine during startup
+
+	bool isEmpty() const  { return iwad.isEmpty() && load.isEmpty() && startupTitle.isEmpty(); }
+};
+
+/// All the information about a pk3 file, extracted from a single pass through the zip file.
 struct Pk3Info
 {
-	MapInfo mapInfo;   ///< content extracted from a MAPINFO file
+	MapInfo mapInfo;              ///< content extracted from the MAPINFO-like files
+	GameInfo gameInfo;            ///< content extracted from a GAMEINFO file
+	QStringList mapWads;          ///< paths of the WADs in the maps/ directory inside the pk3
+	QStringList embeddedWads;     ///< paths of the WADs in the root directory, the engines load them as additional WADs
+	GameIdentification game;      ///< which game it probably is, only present if one of the embedded WADs is an IWAD
 
 	void serialize( QJsonObject & jsPk3Info ) const;
 	void deserialize( const JsonObjectCtx & jsPk3Info );
+
+	void serialize( QDataStream & stream ) const;
+	void deserialize( QDataStream & stream );
+
+	/// Approximate number of bytes allocated on the heap, used for the cache size accounting.
+	qint64 memoryUsage() const;
 };
 
 using UncertainPk3Info = UncertainFileInfo< Pk3Info >;
 
 /// Reads selected information from a pk3 file.
-/** BEWARE that these file I/O operations may sometimes be expensive, caching the info is adviced. */
+/** All the information is extracted while opening the file only once.
+  * BEWARE that these file I/O operations may sometimes be expensive, caching the info is adviced. */
 UncertainPk3Info readPk3Info( const QString & filePath );
 
 
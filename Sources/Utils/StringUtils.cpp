@@ -48,3 +48,11 @@ QTextStream & operator<<( QTextStream & stream, const QStringList & list )
 
 	return stream;
 }
+
+qint64 heapSize( const QStringList & list )
+{
+	qint64 size = qint64( list.capacity() ) * qint64( sizeof(QString) );
+	for (const QString & str : list)
+		size += heapSize( str );
+	return size;
+}
@@ -46,6 +46,15 @@ QString replaceStringBetween( QString source, char startingChar, char endingChar
 
 QTextStream & operator<<( QTextStream & stream, const QStringList & list );
 
+/// Approximate number of bytes the string has allocated on the heap.
+inline qint64 heapSize( const QString & str )
+{
+	return qint64( str.capacity() ) * qint64( sizeof(QChar) );
+}
+
+/// Approximate number of bytes the list and its strings have allocated on the heap.
+qint64 heapSize( const QStringList & list );
+
 
 //----------------------------------------------------------------------------------------------------------------------
 
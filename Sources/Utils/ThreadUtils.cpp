@@ -0,0 +1,98 @@
+//======================================================================================================================
+// Project: DoomRunner
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: helpers for running work in parallel
+//======================================================================================================================
+
+#include "ThreadUtils.hpp"
+
+#include <QThreadPool>
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+
+
+// One for each directory that is watched at the same time, so that one stuck listing doesn't delay the others.
+// When fewer scans run, the free threads help listing the subdirectories of a tree.
+static constexpr int maxDirScanThreads = 4;
+
+
+void parallelFor( int count, const std::function< void ( int idx ) > & loopBody, QThreadPool * threadPool )
+{
+	if (count <= 0)
+	{
+		return;
+	}
+
+	std::atomic< int > nextIdx = 0;
+
+	// every participant keeps taking the next unprocessed index until there are none left,
+	// so that one slow item does not stall the other threads
+	auto processRemainingItems = [ & ]()
+	{
+		for (int idx = nextIdx++; idx < count; idx = nextIdx++)
+		{
+			loopBody( idx );
+		}
+	};
+
+	std::mutex mtx;
+	std::condition_variable allHelpersFinished;
+	int runningHelpers = 0;
+
+	if (!threadPool)
+		threadPool = QThreadPool::globalInstance();
+	int maxHelpers = std::min( count, threadPool->maxThreadCount() ) - 1;  // the calling thread is one of the workers
+
+	for (int i = 0; i < maxHelpers; ++i)
+	{
+		{
+			std::unique_lock< std::mutex > lock( mtx );
+			runningHelpers++;
+		}
+		// Only use threads that are available right now. If the pool is busy, the calling thread does the work itself
+		// instead of waiting for a queued task that might start only after everything has already been processed.
+		bool started = threadPool->tryStart( [ & ]()
+		{
+			processRemainingItems();
+
+			std::unique_lock< std::mutex > lock( mtx );
+			runningHelpers--;
+			allHelpersFinished.notify_all();
+		});
+		if (!started)
+		{
+			std::unique_lock< std::mutex > lock( mtx );
+			runningHelpers--;
+			break;
+		}
+	}
+
+	processRemainingItems();
+
+	std::unique_lock< std::mutex > lock( mtx );
+	allHelpersFinished.wait( lock, [ & ]() { return runningHelpers == 0; } );
+}
+
+QThreadPool & backgroundThreadPool()
+{
+	// local static variables are initialized under a mutex, so it should be save to use from multiple threads
+	static QThreadPool threadPool;
+	return threadPool;
+}
+
+QThreadPool & dirScanThreadPool()
+{
+	// Deliberately never deleted, because the destructor of QThreadPool waits for the running tasks
+	// and a listing stuck on a network drive would prevent the application from exiting.
+	static QThreadPool * threadPool = []()
+	{
+		auto * pool = new QThreadPool;
+		pool->setMaxThreadCount( maxDirScanThreads );
+		return pool;
+	}();
+	return *threadPool;
+}
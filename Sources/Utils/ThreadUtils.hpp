@@ -0,0 +1,43 @@
+//======================================================================================================================
+// Project: DoomRunner
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: helpers for running work in parallel
+//======================================================================================================================
+
+#ifndef THREAD_UTILS_INCLUDED
+#define THREAD_UTILS_INCLUDED
+
+
+#include "Essential.hpp"
+
+#include <functional>
+
+class QThreadPool;
+
+
+/// Calls loopBody for every index in <0, count) distributing the calls across the threads of a thread pool.
+/** The global thread pool is used when threadPool is null. The calling thread participates in the work too and the function returns only after all the calls are finished.
+  * The order in which the indexes are processed is not defined, so the loopBody should store its result
+  * to a pre-allocated slot corresponding to the index, if the original order needs to be retained.
+  * The loopBody must be safe to be called concurrently from multiple threads. */
+void parallelFor( int count, const std::function< void ( int idx ) > & loopBody, QThreadPool * threadPool = nullptr );
+
+/// Thread pool for tasks running in the background, separate from the global one used by parallelFor().
+/** If a parallelFor() loop waits for a background task that's queued in the same pool whose threads the loop occupies,
+  * the task might never start. */
+QThreadPool & backgroundThreadPool();
+
+/// Thread pool for listing directories, separate from the background one used for reading files.
+/** A directory listing can block in the OS for a very long time on an unresponsive network drive and can't be cancelled
+  * while it's blocked, so it must not occupy the threads that the file reading and pre-fetching depend on. */
+QThreadPool & dirScanThreadPool();
+
+/// Priorities for QThreadPool::start(), tasks with higher priority are taken from the queue first.
+namespace taskPriority {
+	inline constexpr int Normal = 0;
+	inline constexpr int Low = -1;  ///< work that nobody is waiting for yet, like pre-fetching
+}
+
+
+#endif // THREAD_UTILS_INCLUDED
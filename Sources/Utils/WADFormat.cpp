@@ -0,0 +1,121 @@
+//======================================================================================================================
+// Project: DoomRunner
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: binary structures of the WAD format and compact lump name representation
+//======================================================================================================================
+
+#include "WADFormat.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define LUMP_DIR_USE_SSE2 1
+	#include <emmintrin.h>
+#else
+	#define LUMP_DIR_USE_SSE2 0
+#endif
+
+
+namespace doom {
+
+
+//======================================================================================================================
+// lump directory validation
+
+uint32_t findInvalidLumpEntry_scalar( const uchar * lumpDir, uint32_t begin, uint32_t end, qint64 fileSize )
+{
+	for (uint32_t i = begin; i < end; ++i)
+	{
+		if (!isValidLumpEntry( readLumpEntry( lumpDir, i ), fileSize ))
+			return i;
+	}
+	return end;
+}
+
+#if LUMP_DIR_USE_SSE2
+
+/// Whether any of the 8-byte names in the register has a non-printable character before its first null.
+static bool containsNonPrintableName( __m128i twoNames )
+{
+	// signed comparison, so the bytes >= 0x80 fail the first condition
+	const __m128i isPrintable = _mm_and_si128(
+		_mm_cmpgt_epi8( twoNames, _mm_set1_epi8( 0x1F ) ),
+		_mm_cmplt_epi8( twoNames, _mm_set1_epi8( 0x7F ) )
+	);
+	const uint isNull = uint( _mm_movemask_epi8( _mm_cmpeq_epi8( twoNames, _mm_setzero_si128() ) ) );
+	const uint isInvalid = ~uint( _mm_movemask_epi8( isPrintable ) ) & ~isNull & 0xFFFF;
+	if (isInvalid == 0)
+	{
+		return false;  // the most common case
+	}
+
+	// the invalid characters only matter if they are before the end of the name
+	for (uint shift : { 0, 8 })
+	{
+		const uint nulls = (isNull >> shift) & 0xFF;
+		const uint charsBeforeNull = nulls ? (nulls & (~nulls + 1)) - 1 : 0xFF;
+		if ((isInvalid >> shift) & charsBeforeNull)
+			return true;
+	}
+	return false;
+}
+
+uint32_t findInvalidLumpEntry( const uchar * lumpDir, uint32_t numLumps, qint64 fileSize )
+{
+	// With 32-bit unsigned arithmetic (offset <= fileSize && size <= fileSize - offset) is equivalent to the 64-bit check,
+	// but it works only when the file size fits into 32 bits. Bigger files are not worth optimizing.
+	if (fileSize > qint64( UINT32_MAX ))
+	{
+		return findInvalidLumpEntry_scalar( lumpDir, 0, numLumps, fileSize );
+	}
+
+	// SSE2 has only signed comparisons, flipping the highest bit turns them into unsigned ones
+	const __m128i signBit = _mm_set1_epi32( INT32_MIN );
+	const __m128i fileSizeVec = _mm_set1_epi32( int32_t( uint32_t( fileSize ) ) );
+	const __m128i fileSizeBiased = _mm_xor_si128( fileSizeVec, signBit );
+
+	uint32_t i = 0;
+	for (; i + 4 <= numLumps; i += 4)
+	{
+		const uchar * block = lumpDir + size_t( i ) * sizeof(LumpEntry);
+		const __m128i e0 = _mm_loadu_si128( reinterpret_cast< const __m128i * >( block ) );
+		const __m128i e1 = _mm_loadu_si128( reinterpret_cast< const __m128i * >( block + 16 ) );
+		const __m128i e2 = _mm_loadu_si128( reinterpret_cast< const __m128i * >( block + 32 ) );
+		const __m128i e3 = _mm_loadu_si128( reinterpret_cast< const __m128i * >( block + 48 ) );
+
+		// transpose the 4 entries into a vector of offsets and a vector of sizes
+		const __m128i e01 = _mm_unpacklo_epi32( e0, e1 );  // offset0, offset1, size0, size1
+		const __m128i e23 = _mm_unpacklo_epi32( e2, e3 );  // offset2, offset3, size2, size3
+		const __m128i offsets = _mm_unpacklo_epi64( e01, e23 );
+		const __m128i sizes = _mm_unpackhi_epi64( e01, e23 );
+
+		const __m128i remaining = _mm_sub_epi32( fileSizeVec, offsets );  // doesn't matter that it wraps when offset > fileSize
+		const __m128i outOfBounds = _mm_or_si128(
+			_mm_cmpgt_epi32( _mm_xor_si128( offsets, signBit ), fileSizeBiased ),
+			_mm_cmpgt_epi32( _mm_xor_si128( sizes, signBit ), _mm_xor_si128( remaining, signBit ) )
+		);
+
+		if (_mm_movemask_epi8( outOfBounds ) != 0
+		 || containsNonPrintableName( _mm_unpackhi_epi64( e0, e1 ) )
+		 || containsNonPrintableName( _mm_unpackhi_epi64( e2, e3 ) ))
+		{
+			// let the scalar version find which of the 4 it is
+			uint32_t invalidIdx = findInvalidLumpEntry_scalar( lumpDir, i, i + 4, fileSize );
+			if (invalidIdx < i + 4)
+				return invalidIdx;
+		}
+	}
+
+	return findInvalidLumpEntry_scalar( lumpDir, i, numLumps, fileSize );
+}
+
+#else // LUMP_DIR_USE_SSE2
+
+uint32_t findInvalidLumpEntry( const uchar * lumpDir, uint32_t numLumps, qint64 fileSize )
+{
+	return findInvalidLumpEntry_scalar( lumpDir, 0, numLumps, fileSize );
+}
+
+#endif // LUMP_DIR_USE_SSE2
+
+
+} // namespace doom
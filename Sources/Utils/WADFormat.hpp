@@ -0,0 +1,159 @@
+//======================================================================================================================
+// Project: DoomRunner
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: binary structures of the WAD format and compact lump name representation
+//======================================================================================================================
+
+#ifndef WAD_FORMAT_INCLUDED
+#define WAD_FORMAT_INCLUDED
+
+
+#include "Essential.hpp"
+
+#include <QString>
+
+#include <cstring>  // memcpy
+
+
+namespace doom {
+
+
+//======================================================================================================================
+// WAD format structures
+
+// https://doomwiki.org/wiki/WAD
+
+enum class WadType
+{
+	Neither,
+	IWAD,
+	PWAD,
+};
+
+/// section that every WAD file begins with
+struct WadHeader
+{
+	char wadType [4];  ///< either "IWAD" or "PWAD" but the string is NOT null terminated
+	uint32_t numLumps;  ///< number of entries in the lump directory
+	uint32_t lumpDirOffset;  ///< offset of the lump directory in the file
+};
+static_assert( sizeof(WadHeader) == 12, "WadHeader must match the on-disk layout" );
+
+/// one entry of the lump directory
+struct LumpEntry
+{
+	uint32_t dataOffset;
+	uint32_t size;
+	char name [8];  ///< might not be null-terminated when the string takes all 8 bytes
+};
+static_assert( sizeof(LumpEntry) == 16, "LumpEntry must match the on-disk layout" );
+
+/// Reads one entry of the lump directory from an arbitrary (possibly unaligned) position in the file content.
+inline LumpEntry readLumpEntry( const uchar * lumpDir, uint32_t index )
+{
+	LumpEntry lump;
+	memcpy( &lump, lumpDir + size_t( index ) * sizeof(LumpEntry), sizeof(LumpEntry) );
+	return lump;
+}
+
+/// Whether all the characters before the first null are printable ASCII characters.
+inline bool isPrintableLumpName( const char (& name) [8] )
+{
+	for (char c : name)
+	{
+		if (c == '\0')  // the rest of the field is not part of the name
+			break;
+		if (c < 0x20 || c > 0x7E)  // same as isprint() in the "C" locale, but without the locale lookup
+			return false;
+	}
+	return true;
+}
+
+/// Whether the lump lies within the file and its name is a printable text.
+inline bool isValidLumpEntry( const LumpEntry & lump, qint64 fileSize )
+{
+	return qint64( lump.dataOffset ) + qint64( lump.size ) <= fileSize && isPrintableLumpName( lump.name );
+}
+
+/// Validates the whole lump directory at once and returns the index of the first invalid entry,
+/// or numLumps when all the entries are valid.
+/** Uses SSE2 to check several entries per instruction where available. */
+uint32_t findInvalidLumpEntry( const uchar * lumpDir, uint32_t numLumps, qint64 fileSize );
+
+/// Scalar version of findInvalidLumpEntry(), used on platforms without SSE2 and for the remaining entries.
+uint32_t findInvalidLumpEntry_scalar( const uchar * lumpDir, uint32_t begin, uint32_t end, qint64 fileSize );
+
+
+//======================================================================================================================
+// packed lump names
+
+/// Lump name packed into a 64-bit integer, so that it can be compared with a single instruction.
+/** The first character is stored in the lowest byte and the unused bytes after the name end are always zero,
+  * which makes the value independent on the byte order of the platform. */
+using LumpName = uint64_t;
+
+/// Packs a null-terminated string of at most 8 characters. Intended for compile-time constants.
+constexpr LumpName makeLumpName( const char * str )
+{
+	LumpName packed = 0;
+	for (uint i = 0; i < 8 && str[i] != '\0'; ++i)
+		packed |= LumpName( uchar( str[i] ) ) << (8 * i);
+	return packed;
+}
+
+/// Packs the name field of a lump entry, the characters after the first null are discarded.
+inline LumpName packLumpName( const char (& name) [8] )
+{
+	LumpName packed = 0;
+	for (uint i = 0; i < 8; ++i)
+		packed |= LumpName( uchar( name[i] ) ) << (8 * i);
+
+	// clear everything after the first zero byte, because the original string ends there
+	// and the rest of the field can contain garbage
+	LumpName zeroBytes = (packed - 0x0101010101010101ull) & ~packed & 0x8080808080808080ull;
+	if (zeroBytes != 0)
+	{
+		LumpName firstZeroByte = zeroBytes & (~zeroBytes + 1);  // the lowest detected zero byte is always exact
+		packed &= (firstZeroByte >> 7) - 1;
+	}
+	return packed;
+}
+
+constexpr uint lumpNameLength( LumpName name )
+{
+	uint length = 0;
+	while (length < 8 && ((name >> (8 * length)) & 0xFF) != 0)
+		++length;
+	return length;
+}
+
+/// Returns the first \p length characters of the name.
+constexpr LumpName lumpNamePrefix( LumpName name, uint length )
+{
+	return length >= 8 ? name : name & ((LumpName(1) << (8 * length)) - 1);
+}
+
+constexpr bool lumpNameEndsWith( LumpName name, LumpName suffix )
+{
+	uint nameLength = lumpNameLength( name );
+	uint suffixLength = lumpNameLength( suffix );
+	if (suffixLength == 0)
+		return true;
+	return suffixLength <= nameLength && (name >> (8 * (nameLength - suffixLength))) == suffix;
+}
+
+/// Converts the packed name back to a string. Should be done only for names that are actually returned.
+inline QString lumpNameToString( LumpName name )
+{
+	char chars [8];
+	for (uint i = 0; i < 8; ++i)
+		chars[i] = char( (name >> (8 * i)) & 0xFF );
+	return QString::fromLatin1( chars, int( lumpNameLength( name ) ) );
+}
+
+
+} // namespace doom
+
+
+#endif // WAD_FORMAT_INCLUDED
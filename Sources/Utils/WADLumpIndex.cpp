@@ -0,0 +1,252 @@
+//======================================================================================================================
+// Project: DoomRunner
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: index of all lumps of a WAD file for random access by name
+//======================================================================================================================
+
+#include "WADLumpIndex.hpp"
+
+#include "CommonTypes.hpp"  // qsize_t
+#include "ZipReader.hpp"    // ZipEntryReader
+
+#include <QStringBuilder>
+
+#include <cstring>  // memcpy, strncmp
+
+
+namespace doom {
+
+
+// https://doomwiki.org/wiki/WAD
+
+/// Returns the namespace started by this lump, or 0 if it doesn't start any.
+static LumpName namespaceStartedBy( LumpName lumpName )
+{
+	static constexpr LumpName START = makeLumpName("_START");
+	return lumpNameEndsWith( lumpName, START ) ? lumpNamePrefix( lumpName, lumpNameLength( lumpName ) - lumpNameLength( START ) ) : 0;
+}
+
+static bool endsNamespace( LumpName lumpName )
+{
+	static constexpr LumpName END = makeLumpName("_END");
+	return lumpNameEndsWith( lumpName, END );
+}
+
+/// Merges the doubled namespace names (SS, FF, PP) used by PWADs with the original ones (S, F, P).
+static LumpName normalizeNamespace( LumpName nameSpace )
+{
+	if (lumpNameLength( nameSpace ) == 2 && (nameSpace & 0xFF) == (nameSpace >> 8))
+		return nameSpace & 0xFF;
+	return nameSpace;
+}
+
+void WadLumpIndex::clear()
+{
+	_file.close();
+	_type = WadType::Neither;
+	_lumps.clear();
+	_lookupCount = 0;
+	_hashTablesBuilt = false;
+	_lumpsByName.clear();
+	_lumpsByNamespacedName.clear();
+}
+
+ReadStatus WadLumpIndex::open( const QString & filePath )
+{
+	clear();
+	_filePath = filePath;
+
+	ReadStatus openStatus = _file.open( filePath );
+	if (openStatus != ReadStatus::Success)
+	{
+		logRuntimeError().noquote() << "cannot open \""<<filePath<<"\": "<<_file.errorString();
+		return openStatus;
+	}
+
+	const uchar * headerData = _file.dataAt( 0, sizeof(WadHeader) );
+	if (!headerData)
+	{
+		logDebug() << filePath << " is smaller than WAD header";
+		return ReadStatus::InvalidFormat;
+	}
+	WadHeader header;
+	memcpy( &header, headerData, sizeof(header) );
+
+	// the lump directory is basically an array of LumpEntry structs, so we can iterate it directly in the mapped memory
+	qint64 lumpDirSize = qint64( header.numLumps ) * qint64( sizeof(LumpEntry) );
+	const uchar * lumpDir = _file.dataAt( header.lumpDirOffset, lumpDirSize );
+
+	return indexLumps( header, lumpDir, _file.size() );
+}
+
+ReadStatus WadLumpIndex::open( ZipEntryReader & zipReader )
+{
+	clear();
+	_filePath = zipReader.zipFilePath() % '/' % zipReader.entryName();
+
+	if (zipReader.position() != 0 && zipReader.reopenEntry() != ReadStatus::Success)
+	{
+		return ReadStatus::FailedToRead;
+	}
+
+	WadHeader header;
+	if (!zipReader.readExactly( reinterpret_cast< char * >( &header ), sizeof(header) ))
+	{
+		logDebug() << _filePath << " is smaller than WAD header";
+		return ReadStatus::InvalidFormat;
+	}
+
+	// Compressed data can only be read sequentially, so everything up to the directory has to be decompressed,
+	// but it doesn't have to be kept in memory. Directories placed before the lump data are not supported,
+	// no known WAD tool writes them that way.
+	QByteArray lumpDir;
+	qint64 lumpDirSize = qint64( header.numLumps ) * qint64( sizeof(LumpEntry) );
+	if (header.numLumps >= 1 && header.numLumps <= 65536
+	 && header.lumpDirOffset >= sizeof(header) && header.lumpDirOffset + lumpDirSize <= zipReader.entrySize())
+	{
+		lumpDir.resize( qsize_t( lumpDirSize ) );
+		if (!zipReader.skip( header.lumpDirOffset - sizeof(header) )
+		 || !zipReader.readExactly( lumpDir.data(), lumpDirSize ))
+		{
+			return ReadStatus::FailedToRead;
+		}
+	}
+
+	const uchar * lumpDirData = !lumpDir.isEmpty() ? reinterpret_cast< const uchar * >( lumpDir.constData() ) : nullptr;
+	return indexLumps( header, lumpDirData, zipReader.entrySize() );
+}
+
+ReadStatus WadLumpIndex::indexLumps( const WadHeader & header, const uchar * lumpDir, qint64 fileSize )
+{
+	const QString & filePath = _filePath;
+
+	// validate WAD header
+
+	if (strncmp( header.wadType, "IWAD", sizeof(header.wadType) ) == 0)
+		_type = WadType::IWAD;
+	else if (strncmp( header.wadType, "PWAD", sizeof(header.wadType) ) == 0)
+		_type = WadType::PWAD;
+
+	if (_type == WadType::Neither)  // not a WAD format
+	{
+		logDebug() << filePath << ": invalid WAD signature";
+		return ReadStatus::InvalidFormat;
+	}
+
+	// validate the lump directory
+
+	if (header.numLumps < 1 || header.numLumps > 65536)  // some garbage -> not a WAD
+	{
+		logDebug() << filePath << ": invalid number of lumps";
+		return ReadStatus::InvalidFormat;
+	}
+	if (!lumpDir)
+	{
+		logDebug() << filePath << ": lump header points beyond the end of file";
+		return ReadStatus::InvalidFormat;
+	}
+
+	// validate all the entries first, so that the loop below doesn't have to check each one separately
+	uint32_t invalidIdx = findInvalidLumpEntry( lumpDir, header.numLumps, fileSize );
+	if (invalidIdx < header.numLumps)  // some garbage -> not a WAD
+	{
+		const LumpEntry lump = readLumpEntry( lumpDir, invalidIdx );
+		if (qint64( lump.dataOffset ) + qint64( lump.size ) > fileSize)
+			logDebug() << filePath << ": lump points beyond the end of file";
+		else
+			logDebug() << filePath << ": lump name is not a printable text";
+		return ReadStatus::InvalidFormat;
+	}
+
+	// index the lumps
+
+	_lumps.reserve( header.numLumps );
+
+	LumpName currentNamespace = 0;
+	for (uint32_t i = 0; i < header.numLumps; ++i)
+	{
+		const LumpEntry entry = readLumpEntry( lumpDir, i );
+		const LumpName lumpName = packLumpName( entry.name );
+
+		// the namespace markers themselves belong to the global namespace
+		LumpName lumpNamespace = 0;
+		if (LumpName startedNamespace = namespaceStartedBy( lumpName ))
+			currentNamespace = normalizeNamespace( startedNamespace );
+		else if (endsNamespace( lumpName ))
+			currentNamespace = 0;
+		else
+			lumpNamespace = currentNamespace;
+
+		_lumps.push_back({ lumpName, lumpNamespace, entry.dataOffset, entry.size });
+	}
+
+	return ReadStatus::Success;
+}
+
+bool WadLumpIndex::useHashTables() const
+{
+	if (_hashTablesBuilt)
+		return true;
+
+	if (++_lookupCount <= lookupsBeforeHashing)
+		return false;
+
+	_lumpsByName.reserve( qsize_t( _lumps.size() ) );
+	for (size_t i = 0; i < _lumps.size(); ++i)
+	{
+		const Lump & lump = _lumps[i];
+		// later lumps override the earlier ones
+		_lumpsByName.insert( lump.name, int( i ) );
+		if (lump.nameSpace != 0)
+			_lumpsByNamespacedName.insert( { lump.nameSpace, lump.name }, int( i ) );
+	}
+	_hashTablesBuilt = true;
+
+	return true;
+}
+
+int WadLumpIndex::findLump( LumpName name ) const
+{
+	if (useHashTables())
+		return _lumpsByName.value( name, NotFound );
+
+	// search backwards, the last lump with this name wins
+	for (size_t i = _lumps.size(); i-- > 0; )
+		if (_lumps[i].name == name)
+			return int( i );
+	return NotFound;
+}
+
+int WadLumpIndex::findLump( LumpName name, LumpName nameSpace ) const
+{
+	if (nameSpace == 0)
+		return findLump( name );
+
+	nameSpace = normalizeNamespace( nameSpace );
+
+	if (useHashTables())
+		return _lumpsByNamespacedName.value( { nameSpace, name }, NotFound );
+
+	for (size_t i = _lumps.size(); i-- > 0; )
+		if (_lumps[i].name == name && _lumps[i].nameSpace == nameSpace)
+			return int( i );
+	return NotFound;
+}
+
+QByteArray WadLumpIndex::lumpData( int idx ) const
+{
+	if (!hasLumpData())
+	{
+		logLogicError() << "lump data of "<<_filePath<<" are not available, it's embedded in a zip file";
+		return {};
+	}
+
+	const Lump & lump = _lumps[ size_t( idx ) ];
+	// all the lumps were validated in open(), so they are within the file
+	const char * lumpData = reinterpret_cast< const char * >( _file.data() + lump.dataOffset );
+	return QByteArray::fromRawData( lumpData, qsize_t( lump.size ) );
+}
+
+
+} // namespace doom
@@ -0,0 +1,118 @@
+//======================================================================================================================
+// Project: DoomRunner
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: index of all lumps of a WAD file for random access by name
+//======================================================================================================================
+
+#ifndef WAD_LUMP_INDEX_INCLUDED
+#define WAD_LUMP_INDEX_INCLUDED
+
+
+#include "Essential.hpp"
+
+#include "WADFormat.hpp"
+#include "MappedFile.hpp"
+#include "FileInfoCacheTypes.hpp"  // ReadStatus
+#include "ErrorHandling.hpp"  // LoggingComponent
+
+#include <QString>
+#include <QByteArray>
+#include <QHash>
+
+#include <vector>
+#include <utility>  // pair
+
+class ZipEntryReader;
+
+
+namespace doom {
+
+
+//======================================================================================================================
+/// Index of all lumps of a WAD file, built from a single pass over the lump directory.
+/** The file is memory-mapped and stays mapped as long as the index exists, so the lump content can be accessed
+  * directly without copying. All the extractors of information from a WAD (game identification, MAPINFO parsing, ...)
+  * should work with this instead of reading the file on their own. */
+
+class WadLumpIndex : protected LoggingComponent {
+
+ public:
+
+	struct Lump
+	{
+		LumpName name;
+		LumpName nameSpace;   ///< for example "S" for lumps between S_START and S_END, 0 for the global namespace
+		uint32_t dataOffset;
+		uint32_t size;
+	};
+
+	static constexpr int NotFound = -1;
+
+	WadLumpIndex() : LoggingComponent( u"WadLumpIndex" ) {}
+
+	/// Maps the file into memory, validates its structure and indexes all its lumps.
+	/** Returns InvalidFormat when it's not a valid WAD file. */
+	ReadStatus open( const QString & filePath );
+
+	/// Indexes a WAD embedded in a zip file, the WAD must be the currently open entry of the zipReader.
+	/** Only the header and the lump directory are decompressed into memory, the data before the directory
+	  * are decompressed in chunks and discarded. The lump content is not available in this case,
+	  * it has to be read from the zipReader. Returns InvalidFormat when it's not a valid WAD file. */
+	ReadStatus open( ZipEntryReader & zipReader );
+
+	WadType type() const                { return _type; }
+	const QString & filePath() const    { return _filePath; }
+
+	/// Whether lumpData() can be used, false for WADs embedded in zip files.
+	bool hasLumpData() const            { return _file.isOpen(); }
+
+	int lumpCount() const               { return int( _lumps.size() ); }
+	const Lump & lump( int idx ) const  { return _lumps[ size_t( idx ) ]; }
+	auto begin() const                  { return _lumps.begin(); }
+	auto end() const                    { return _lumps.end(); }
+
+	/// Returns index of a lump with this name in any namespace, or NotFound.
+	/** When there are more lumps with the same name, the last one is returned, because that's the one the engines use.
+	  * The first few lookups scan the lumps linearly, the hash tables are built only when more lookups follow,
+	  * so the common case of looking up a handful of lumps doesn't allocate anything. */
+	int findLump( LumpName name ) const;
+
+	/// Returns index of a lump with this name within a namespace (for example "S" or "F"), or NotFound.
+	/** Doubled namespace names like SS_START or FF_START are merged with the single-letter ones. */
+	int findLump( LumpName name, LumpName nameSpace ) const;
+
+	/// Returns a view of the lump content inside the mapped file. The view is valid only as long as this index exists.
+	QByteArray lumpData( int idx ) const;
+
+ private:
+
+	void clear();
+
+	/// Validates the header and the lump directory and indexes all the lumps.
+	ReadStatus indexLumps( const WadHeader & header, const uchar * lumpDir, qint64 fileSize );
+
+	/// Counts the lookup and returns whether the hash tables should be used for it, builds them when it's time.
+	bool useHashTables() const;
+
+	/// After this many lookups, building the hash tables becomes cheaper than scanning the lumps over and over.
+	static constexpr int lookupsBeforeHashing = 8;
+
+	QString _filePath;
+	fs::MappedFile _file;
+	WadType _type = WadType::Neither;
+	std::vector< Lump > _lumps;
+
+	// built lazily on demand, see findLump()
+	mutable int _lookupCount = 0;
+	mutable bool _hashTablesBuilt = false;
+	mutable QHash< LumpName, int > _lumpsByName;
+	mutable QHash< std::pair< LumpName, LumpName >, int > _lumpsByNamespacedName;
+
+};
+
+
+} // namespace doom
+
+
+#endif // WAD_LUMP_INDEX_INCLUDED
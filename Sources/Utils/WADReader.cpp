@@ -7,16 +7,18 @@
 
 #include "WADReader.hpp"
 
+#include "WADFormat.hpp"
+#include "WADLumpIndex.hpp"
 #include "DoomFiles.hpp"  // identifyGame
+#include "ZipReader.hpp"  // ZipEntryReader
+#include "CommonTypes.hpp"  // qsize_t
 #include "ErrorHandling.hpp"
 
-#include <QSet>
-#include <QFile>
-#include <QFileInfo>
-#include <QDateTime>
+#include <QDataStream>
+#include <QStringBuilder>
 
-#include <cctype>
-#include <memory>
+#include <algorithm>  // find
+#include <functional>
 
 
 namespace doom {
@@ -42,6 +44,32 @@ void WadInfo::deserialize( const JsonObjectCtx & jsWadInfo )
 }
 
 
+//======================================================================================================================
+// binary serialization
+
+void WadInfo::serialize( QDataStream & stream ) const
+{
+	stream << qint32( type );
+	stream << QString( game.gzdoomID );  // the pointers must be restored from the table of known games
+	mapInfo.serialize( stream );
+}
+
+void WadInfo::deserialize( QDataStream & stream )
+{
+	qint32 typeInt;
+	QString gameID;
+	stream >> typeInt >> gameID;
+	type = WadType( typeInt );
+	game = findGameByID( gameID );
+	mapInfo.deserialize( stream );
+}
+
+qint64 WadInfo::memoryUsage() const
+{
+	return mapInfo.memoryUsage();  // the game identification points to static strings
+}
+
+
 //======================================================================================================================
 // implementation
 
@@ -54,8 +82,14 @@ class LoggingWadReader : protected LoggingComponent {
 
 	UncertainWadInfo readWadInfo();
 
+	UncertainWadInfo readWadInfoInsideZip( ZipEntryReader & zipReader );
+
  private:
 
+	void extractWadInfo(
+		const WadLumpIndex & lumpIndex, const std::function< QByteArray ( int lumpIdx ) > & readLump, WadInfo & wadInfo
+	);
+
 	QString _filePath;
 
 };
@@ -66,60 +100,30 @@ class LoggingWadReader : protected LoggingComponent {
 
 // https://doomwiki.org/wiki/WAD
 
-/// section that every WAD file begins with
-struct WadHeader
-{
-	char wadType [4];  ///< either "IWAD" or "PWAD" but the string is NOT null terminated
-	uint32_t numLumps;  ///< number of entries in the lump directory
-	uint32_t lumpDirOffset;  ///< offset of the lump directory in the file
-};
-
-/// one entry of the lump directory
-struct LumpEntry
-{
-	uint32_t dataOffset;
-	uint32_t size;
-	char name [8];  ///< might not be null-terminated when the string takes all 8 bytes
-};
-
-template< size_t N >
-QString charArrayToString( const char (&arr) [N] )
-{
-	// we need to make sure we have a null-terminated string, because the original one isn't when it's 8 chars long
-	char arr0 [N+1];
-	strncpy( arr0, arr, std::min( sizeof(arr0), sizeof(arr) ) );
-	arr0[N] = '\0';
-	return QString( arr0 );
-}
-
-static bool isPrintableAsciiString( const QString & str )
+static constexpr LumpName blacklistedNames [] =
 {
-	const auto strLatin = str.toLatin1();
-	for (auto c : strLatin)
-		if (!isprint( c ))
-			return false;
-	return true;
-}
-
-static const QSet< QString > blacklistedNames =
-{
-	"SEGS",
-	"SECTORS",
-	"SSECTORS",
-	"LINEDEFS",
-	"SIDEDEFS",
-	"VERTEXES",
-	"NODES",
-	"BLOCKMAP",
-	"REJECT",
+	makeLumpName("SEGS"),
+	makeLumpName("SECTORS"),
+	makeLumpName("SSECTORS"),
+	makeLumpName("LINEDEFS"),
+	makeLumpName("SIDEDEFS"),
+	makeLumpName("VERTEXES"),
+	makeLumpName("NODES"),
+	makeLumpName("BLOCKMAP"),
+	makeLumpName("REJECT"),
 };
 
-static bool isMapMarker( const LumpEntry & lump, const QString & lumpName )
+static bool isMapMarker( const WadLumpIndex::Lump & lump )
 {
-	return lump.size == 0
-		&& !lumpName.endsWith("_START") && !lumpName.endsWith("_END")
-		&& !lumpName.endsWith("_S") && !lumpName.endsWith("_E")
-		&& !blacklistedNames.contains( lumpName );
+	static constexpr LumpName START = makeLumpName("_START");
+	static constexpr LumpName END   = makeLumpName("_END");
+	static constexpr LumpName S     = makeLumpName("_S");
+	static constexpr LumpName E     = makeLumpName("_E");
+
+	return lump.size == 0 && lump.name != 0
+		&& !lumpNameEndsWith( lump.name, START ) && !lumpNameEndsWith( lump.name, END )
+		&& !lumpNameEndsWith( lump.name, S ) && !lumpNameEndsWith( lump.name, E )
+		&& std::find( std::begin(blacklistedNames), std::end(blacklistedNames), lump.name ) == std::end(blacklistedNames);
 }
 
 UncertainWadInfo LoggingWadReader::readWadInfo()
@@ -132,143 +136,111 @@ UncertainWadInfo LoggingWadReader::readWadInfo()
 		return wadInfo;
 	}
 
-	QFile file( _filePath );
-	if (!file.open( QIODevice::ReadOnly ))
-	{
-		logRuntimeError().noquote() << "cannot open \""<<_filePath<<"\": "<<file.errorString();
-		wadInfo.status = ReadStatus::CantOpen;
-		return wadInfo;
-	}
-
-	const qint64 fileSize = file.size();
-	if (fileSize < 0)
-	{
-		logLogicError() << _filePath << ": file size is negative ("<<fileSize<<"), wtf??";
-		wadInfo.status = ReadStatus::FailedToRead;
-		return wadInfo;
-	}
-
-	// read and validate WAD header
-
-	WadHeader header;
-	if (qint64( sizeof(header) ) > fileSize)
-	{
-		logDebug() << _filePath << " is smaller than WAD header";
-		wadInfo.status = ReadStatus::InvalidFormat;
-		return wadInfo;
-	}
-	else if (file.read( (char*)&header, sizeof(header) ) < qint64( sizeof(header) ))
+	// The index maps the whole file into memory instead of reading it into buffers,
+	// the lump directory is walked in place and only the needed lumps are touched.
+	WadLumpIndex lumpIndex;
+	ReadStatus openStatus = lumpIndex.open( _filePath );
+	if (openStatus != ReadStatus::Success)
 	{
-		logRuntimeError() << _filePath << ": failed to read WAD header";
-		wadInfo.status = ReadStatus::FailedToRead;
+		wadInfo.status = openStatus;
 		return wadInfo;
 	}
 
-	if (strncmp( header.wadType, "IWAD", sizeof(header.wadType) ) == 0)
-		wadInfo.type = WadType::IWAD;
-	else if (strncmp( header.wadType, "PWAD", sizeof(header.wadType) ) == 0)
-		wadInfo.type = WadType::PWAD;
-	else
-		wadInfo.type = WadType::Neither;
+	extractWadInfo( lumpIndex, [ &lumpIndex ]( int lumpIdx ) { return lumpIndex.lumpData( lumpIdx ); }, wadInfo );
 
-	if (wadInfo.type == WadType::Neither)  // not a WAD format
-	{
-		logDebug() << _filePath << ": invalid WAD signature";
-		wadInfo.status = ReadStatus::InvalidFormat;
-		return wadInfo;
-	}
+	wadInfo.status = ReadStatus::Success;
+	return wadInfo;
+}
 
-	// read all lumps
+UncertainWadInfo LoggingWadReader::readWadInfoInsideZip( ZipEntryReader & zipReader )
+{
+	UncertainWadInfo wadInfo;
 
-	if (header.numLumps < 1 || header.numLumps > 65536)  // some garbage -> not a WAD
+	// only the header and the lump directory are kept in memory, the rest is skipped
+	WadLumpIndex lumpIndex;
+	ReadStatus openStatus = lumpIndex.open( zipReader );
+	if (openStatus != ReadStatus::Success)
 	{
-		logDebug() << _filePath << ": invalid number of lumps";
-		wadInfo.status = ReadStatus::InvalidFormat;
-		return wadInfo;
-	}
-	qint64 lumpDirSize = header.numLumps * sizeof(LumpEntry);
-	if (header.lumpDirOffset + lumpDirSize > fileSize)
-	{
-		logDebug() << _filePath << ": lump header points beyond the end of file";
-		wadInfo.status = ReadStatus::InvalidFormat;
-		return wadInfo;
-	}
-	// the lump directory is basically an array of LumpEntry structs, so let's read it all at once
-	std::unique_ptr< LumpEntry [] > lumpDir( new LumpEntry [header.numLumps] );
-	if (!file.seek( header.lumpDirOffset ) || file.read( (char*)lumpDir.get(), lumpDirSize ) < lumpDirSize)
-	{
-		logRuntimeError() << _filePath << ": failed to read the lump directory";
-		wadInfo.status = ReadStatus::FailedToRead;
+		wadInfo.status = openStatus;
 		return wadInfo;
 	}
 
-	QSet< QString > lumpNames;
-
-	for (uint32_t i = 0; i < header.numLumps; ++i)
+	// the few lumps we need are decompressed again, starting from the beginning only if they are before the current position
+	auto readLump = [ this, &lumpIndex, &zipReader ]( int lumpIdx ) -> QByteArray
 	{
-		LumpEntry & lump = lumpDir[i];
-		QString lumpName = charArrayToString( lump.name );
-
-		if (lump.dataOffset + lump.size > fileSize)  // some garbage -> not a WAD
+		const WadLumpIndex::Lump & lump = lumpIndex.lump( lumpIdx );
+		if (lump.size > maxExtractedFileSize)
 		{
-			logDebug() << _filePath << ": lump points beyond the end of file";
-			wadInfo.status = ReadStatus::InvalidFormat;
-			return wadInfo;
+			logRuntimeError() << "Refusing to read lump "<<lumpNameToString( lump.name )<<" of "<<_filePath
+			                  << ", because it is too large ("<<lump.size<<" bytes)";
+			return {};
 		}
-		else if (!isPrintableAsciiString( lumpName ))  // some garbage -> not a WAD
+		if (lump.dataOffset < zipReader.position() && zipReader.reopenEntry() != ReadStatus::Success)
 		{
-			logDebug() << _filePath << ": lump name is not a printable text";
-			wadInfo.status = ReadStatus::InvalidFormat;
-			return wadInfo;
+			return {};
 		}
-
-		lumpNames.insert( lumpName );
-
-		// try to gather the map names from the marker lumps,
-		// but if we find a MAPINFO lump, let that one override the markers
-
-		if (isMapMarker( lump, lumpName ))
+		QByteArray lumpData;
+		lumpData.resize( qsize_t( lump.size ) );
+		if (!zipReader.skip( lump.dataOffset - zipReader.position() ) || !zipReader.readExactly( lumpData.data(), lump.size ))
 		{
-			wadInfo.mapInfo.mapNames.append( lumpName );
+			return {};
 		}
+		return lumpData;
+	};
 
-		if (lumpName == "MAPINFO")
+	extractWadInfo( lumpIndex, readLump, wadInfo );
+
+	wadInfo.status = ReadStatus::Success;
+	return wadInfo;
+}
+
+void LoggingWadReader::extractWadInfo(
+	const WadLumpIndex & lumpIndex, const std::function< QByteArray ( int lumpIdx ) > & readLump, WadInfo & wadInfo
+){
+	wadInfo.type = lumpIndex.type();
+
+	// if there are map-definition lumps, let them override the map markers,
+	// when a map is defined in several of them, the one preferred by the engines takes precedence
+	static constexpr LumpName ZMAPINFO = makeLumpName("ZMAPINFO");
+	static constexpr LumpName MAPINFO = makeLumpName("MAPINFO");
+	static constexpr LumpName UMAPINFO = makeLumpName("UMAPINFO");
+	static constexpr LumpName EMAPINFO = makeLumpName("EMAPINFO");
+	MapInfoReader mapInfoReader( _filePath, [ & ]( const QString & includePath ) -> std::optional< QByteArray >
+	{
+		// inside a WAD, the includes can only refer to other lumps by their name
+		if (includePath.size() > 8)
+			return std::nullopt;
+		int lumpIdx = lumpIndex.findLump( makeLumpName( includePath.toUpper().toLatin1().constData() ) );
+		if (lumpIdx == WadLumpIndex::NotFound)
+			return std::nullopt;
+		return readLump( lumpIdx );
+	});
+	for (LumpName mapDefLump : { ZMAPINFO, MAPINFO, UMAPINFO, EMAPINFO })
+	{
+		int mapDefIdx = lumpIndex.findLump( mapDefLump );
+		if (mapDefIdx != WadLumpIndex::NotFound)
 		{
-			qint64 origPos = file.pos();
-
-			if (!file.seek( lump.dataOffset ))
-			{
-				logRuntimeError() << _filePath << ": failed to seek to lump offset";
-				wadInfo.status = ReadStatus::FailedToRead;
-				return wadInfo;
-			}
-
-			QByteArray lumpData = file.read( lump.size );
-			if (lumpData.size() < qsize_t( lump.size ))
-			{
-				file.seek( origPos );
-				continue;
-			}
-
-			wadInfo.mapInfo = parseMapInfo( lumpData );
-
-			// If it's PWAD, we are done, list of maps is all we need.
-			// If it's IWAD, we need to go through all the lumps, in order to identify the game.
-			if (wadInfo.type != WadType::IWAD)
-			{
-				break;
-			}
+			QByteArray lumpData = readLump( mapDefIdx );
+			wadInfo.mapInfo.merge(
+				mapDefLump == EMAPINFO ? parseEMapInfo( lumpData ) : mapInfoReader.parseMapInfo( lumpData, lumpNameToString( mapDefLump ) )
+			);
 		}
 	}
 
-	wadInfo.status = ReadStatus::Success;
+	if (wadInfo.mapInfo.mapNames.isEmpty())  // try to gather the map names from the marker lumps
+	{
+		for (const WadLumpIndex::Lump & lump : lumpIndex)
+			if (isMapMarker( lump ))
+				wadInfo.mapInfo.mapNames.append( lumpNameToString( lump.name ) );
+	}
 
 	if (wadInfo.type == WadType::IWAD)
 	{
-		wadInfo.game = identifyGame( lumpNames );
+		GameSignature gameSignature;
+		for (const WadLumpIndex::Lump & lump : lumpIndex)
+			gameSignature.addLump( lump.name );
+		wadInfo.game = identifyGame( gameSignature );
 	}
-
-	return wadInfo;
 }
 
 
@@ -281,6 +253,12 @@ UncertainWadInfo readWadInfo( const QString & filePath )
 	return wadReader.readWadInfo();
 }
 
+UncertainWadInfo readWadInfoInsideZip( ZipEntryReader & zipReader )
+{
+	LoggingWadReader wadReader( zipReader.zipFilePath() % '/' % zipReader.entryName() );
+	return wadReader.readWadInfoInsideZip( zipReader );
+}
+
 
 } // namespace doom
 
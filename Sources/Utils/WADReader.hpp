@@ -12,6 +12,7 @@
 #include "Essential.hpp"
 
 #include "DoomFiles.hpp"  // GameIdentification
+#include "WADFormat.hpp"  // WadType
 #include "MapInfo.hpp"  // MapInfo
 #include "FileInfoCache.hpp"
 
@@ -19,26 +20,27 @@
 
 class QJsonObject;
 class JsonObjectCtx;
+class QDataStream;
+class ZipEntryReader;
 
 
 namespace doom {
 
 
-enum class WadType
-{
-	Neither,
-	IWAD,
-	PWAD,
-};
-
 struct WadInfo
 {
 	WadType type = WadType::Neither;
 	GameIdentification game;   ///< which game it probably is, only present if the type == IWAD
-	MapInfo mapInfo;           ///< content extracted from a MAPINFO file
+	MapInfo mapInfo;           ///< content extracted from the map-definition lumps
 
 	void serialize( QJsonObject & jsWadInfo ) const;
 	void deserialize( const JsonObjectCtx & jsWadInfo );
+
+	void serialize( QDataStream & stream ) const;
+	void deserialize( QDataStream & stream );
+
+	/// Approximate number of bytes allocated on the heap, used for the cache size accounting.
+	qint64 memoryUsage() const;
 };
 
 using UncertainWadInfo = UncertainFileInfo< WadInfo >;
@@ -47,6 +49,11 @@ using UncertainWadInfo = UncertainFileInfo< WadInfo >;
 /** BEWARE that these file I/O operations may sometimes be expensive, caching the info is adviced. */
 UncertainWadInfo readWadInfo( const QString & filePath );
 
+/// Reads selected information from a WAD file embedded in a zip file, the WAD must be the currently open entry.
+/** Only the header, the lump directory and the map-definition lumps are decompressed into memory, the rest of the WAD
+  * is decompressed in chunks and discarded, so the memory usage doesn't depend on the size of the WAD. */
+UncertainWadInfo readWadInfoInsideZip( ZipEntryReader & zipReader );
+
 
 } // namespace doom
 
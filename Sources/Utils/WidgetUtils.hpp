@@ -13,7 +13,8 @@
 
 #include "DataModels/GenericListModel.hpp"
 #include "ContainerUtils.hpp"    // findSuch
-#include "FileSystemUtils.hpp"   // traverseDirectory
+#include "FileSystemUtils.hpp"   // PathConvertor
+#include "DirScanner.hpp"        // DirSnapshot
 #include "ErrorHandling.hpp"
 
 #include <QAbstractItemView>
@@ -26,10 +27,14 @@
 #include <QDir>
 #include <QDirIterator>
 #include <QFileInfo>
+#include <QHash>
 class QTableWidget;
 class QAbstractButton;
 
 #include <functional>
+#include <memory>
+#include <vector>
+#include <algorithm>
 
 
 //======================================================================================================================
@@ -600,42 +605,134 @@ bool editCellAtIndex( QTableView * view, int row, int column );
 // common complete update helpers
 
 
-/// Fills a model with entries found in a directory.
+/// Updates the model to the new content by inserting and removing only the rows that differ.
+/** Both the current content of the model and the new content must be ordered the same way (for example both sorted).
+  * The rows that remain are not touched, so the selection, the current item, the scroll position and the item under
+  * the mouse cursor are preserved by the view. When the remaining items would have to be moved or when nothing
+  * remains at all, the model is reset instead, which is cheaper in that case. Returns true if the model was reset. */
 template< typename ListModel >
-void updateModelFromDir(
-	ListModel & model, const QString & dir, bool recursively, bool includeEmptyItem,
-	const PathConvertor & pathConvertor, std::function< bool ( const QFileInfo & file ) > isDesiredFile
-){
+bool updateModelDifferentially( ListModel & model, typename ListModel::Container && newItems )
+{
 	using Item = typename ListModel::Item;
 
-	// Doing a differential update (removing only things that were deleted and adding only things that were added)
-	// is not worth here. It's too complicated and prone to bugs and its advantages are too small.
-	// Instead we just clear everything and then load it from scratch according to the current state of the directory
-	// and update selection and scroll bar.
+	// where each item should end up, also serves as a set of the IDs that will remain
+	QHash< QString, int > newPositions;
+	newPositions.reserve( int( newItems.size() ) );
+	for (int newIdx = 0; newIdx < int( newItems.size() ); ++newIdx)
+		newPositions.insert( newItems[ newIdx ].getID(), newIdx );
+
+	// The items that remain must be in the same relative order as in the new content, otherwise they would have
+	// to be moved. This normally holds, because the directory is traversed and sorted the same way every time.
+	bool canBeMerged = newPositions.size() == int( newItems.size() );  // duplicate IDs cannot be matched reliably
+	int lastPos = -1;
+	int remainingCount = 0;
+	for (const Item & item : model)
+	{
+		int newPos = newPositions.value( item.getID(), -1 );
+		if (newPos < 0)
+			continue;
+		if (newPos <= lastPos)
+			canBeMerged = false;
+		lastPos = newPos;
+		remainingCount++;
+	}
+	if (!canBeMerged || (remainingCount == 0 && model.size() > 0))
+	{
+		model.startCompleteUpdate();
+		model.assignList( std::move(newItems) );
+		model.finishCompleteUpdate();
+		return true;
+	}
+
+	// remove the ranges of deleted items, from the end so that the positions of the preceding ranges don't shift
+	for (int row = int( model.size() ) - 1; row >= 0; )
+	{
+		if (newPositions.contains( model[ row ].getID() ))
+		{
+			row--;
+			continue;
+		}
+		int rangeEnd = row + 1;
+		while (row >= 0 && !newPositions.contains( model[ row ].getID() ))
+			row--;
+		int rangeBeg = row + 1;
+
+		model.startRemovingItems( rangeBeg, rangeEnd - rangeBeg );
+		model.removeCountAt( rangeBeg, rangeEnd - rangeBeg );
+		model.finishRemovingItems();
+	}
+
+	// now the model is a subsequence of the new content, merge the ranges of added items into it
+	int row = 0;
+	for (int newIdx = 0; newIdx < int( newItems.size() ); )
+	{
+		if (row < int( model.size() ) && model[ row ].getID() == newItems[ newIdx ].getID())
+		{
+			row++;
+			newIdx++;
+			continue;
+		}
+		std::vector< std::unique_ptr< Item > > addedItems;
+		while (newIdx < int( newItems.size() ) && !(row < int( model.size() ) && model[ row ].getID() == newItems[ newIdx ].getID()))
+		{
+			addedItems.push_back( newItems.takePtr( newIdx ) );
+			newIdx++;
+		}
+		int addedCount = int( addedItems.size() );
+
+		model.startInsertingItems( row, addedCount );
+		model.insertPtrs( row, std::move(addedItems) );
+		model.finishInsertingItems();
+
+		row += addedCount;
+	}
+
+	return false;
+}
+
+/// Fills a model with entries from a directory snapshot.
+/** Only the rows of the files that were added or removed since the last update are inserted or removed,
+  * see updateModelDifferentially(). Returns true if the model had to be reset, which loses the selection. */
+template< typename ListModel >
+bool updateModelFromDir(
+	ListModel & model, const DirSnapshot & snapshot, bool includeEmptyItem,
+	std::function< bool ( const QFileInfo & file ) > isDesiredFile
+){
+	using Item = typename ListModel::Item;
 
-	model.startCompleteUpdate();  // this resets the highlighted item pointed to by a mouse cursor,
-	                              // but that's an acceptable drawback, instead of making differential update
-	clearButKeepAllocated( model );
+	// Load the current state of the directory into a separate list first and then compare it with the model,
+	// so that the views don't have to reset and re-sort everything on each update.
+	typename ListModel::Container newItems;
 
 	// in combo-box item cannot be deselected, so we provide an empty item to express "no selection"
 	if (includeEmptyItem)
-		model.append( Item() );
+		newItems.append( Item() );
 
-	traverseDirectory( dir, recursively, fs::EntryType::FILE, pathConvertor, [&]( const QFileInfo & file )
+	for (const QFileInfo & file : snapshot.files)
 	{
 		if (isDesiredFile( file ))
 		{
-			model.append( Item( file ) );
+			newItems.append( Item( file ) );
 		}
-	});
+	}
 
 	// some operating systems don't traverse the directory entries in alphabetical order, so we need to sort them on our own
 	if constexpr (!IS_WINDOWS && !IS_MACOS)
 	{
-		model.sortByID();  // for most item types, their ID is either their file name or file path
+		// for most item types, their ID is either their file name or file path, the empty item always stays first
+		std::sort( newItems.begin(), newItems.end(), []( const Item & i1, const Item & i2 ) { return i1.getID() < i2.getID(); } );
 	}
 
-	model.finishCompleteUpdate();
+	return updateModelDifferentially( model, std::move(newItems) );
+}
+
+/// Fills a model with entries found in a directory. The directory is read in the calling thread.
+template< typename ListModel >
+bool updateModelFromDir(
+	ListModel & model, const QString & dir, bool recursively, bool includeEmptyItem,
+	const PathConvertor & pathConvertor, std::function< bool ( const QFileInfo & file ) > isDesiredFile
+){
+	return updateModelFromDir( model, *takeDirSnapshot( dir, recursively, pathConvertor ), includeEmptyItem, isDesiredFile );
 }
 
 
@@ -751,11 +848,11 @@ bool areSelectionsEqual( const QList< ItemID > & selection1, const QList< ItemID
 	return orderedSelection1 == orderedSelection2;
 }
 
-/// Fills a list with entries found in a directory.
+/// Fills a list with entries from a directory snapshot.
 template< typename ListModel >
 void updateListFromDir(
-	ListModel & model, QListView * view, const QString & dir, bool recursively,
-	const PathConvertor & pathConvertor, std::function< bool ( const QFileInfo & file ) > isDesiredFile )
+	ListModel & model, QListView * view, const DirSnapshot & snapshot,
+	std::function< bool ( const QFileInfo & file ) > isDesiredFile )
 {
 	// note down the current scroll bar position
 	auto scrollPos = view->verticalScrollBar()->value();
@@ -766,20 +863,31 @@ void updateListFromDir(
 	// note down the selected items
 	auto selectedItemIDs = getSelectedItemIDs( view, model );  // empty string when nothing is selected
 
-	deselectAllAndUnsetCurrent( view );
-
-	updateModelFromDir( model, dir, recursively, /*includeEmptyItem*/false, pathConvertor, isDesiredFile );
+	bool wasReset = updateModelFromDir( model, snapshot, /*includeEmptyItem*/false, isDesiredFile );
 
-	// restore the selection so that the same file remains selected
-	selectItemsByIDs( view, model, selectedItemIDs );
+	// when only the changed rows were inserted or removed, the view keeps the selection on its own
+	if (wasReset)
+	{
+		// restore the selection so that the same file remains selected
+		selectItemsByIDs( view, model, selectedItemIDs );
 
-	// restore the current item so that the same file remains current
-	setCurrentItemByID( view, model, currentItemID );
+		// restore the current item so that the same file remains current
+		setCurrentItemByID( view, model, currentItemID );
+	}
 
 	// restore the scroll bar position, so that it doesn't move when an item is selected
 	view->verticalScrollBar()->setValue( scrollPos );
 }
 
+/// Fills a list with entries found in a directory. The directory is read in the calling thread.
+template< typename ListModel >
+void updateListFromDir(
+	ListModel & model, QListView * view, const QString & dir, bool recursively,
+	const PathConvertor & pathConvertor, std::function< bool ( const QFileInfo & file ) > isDesiredFile )
+{
+	updateListFromDir( model, view, *takeDirSnapshot( dir, recursively, pathConvertor ), isDesiredFile );
+}
+
 
 
 
@@ -816,24 +924,32 @@ bool setCurrentItemByID( QComboBox * comboBox, const ListModel & model, const QS
 	return false;
 }
 
-/// Fills a combo-box with entries found in a directory.
+/// Fills a combo-box with entries from a directory snapshot.
 template< typename ListModel >
 void updateComboBoxFromDir(
-	ListModel & model, QComboBox * comboBox, const QString & dir, bool recursively, bool includeEmptyItem,
-	const PathConvertor & pathConvertor, std::function< bool ( const QFileInfo & file ) > isDesiredFile )
+	ListModel & model, QComboBox * comboBox, const DirSnapshot & snapshot, bool includeEmptyItem,
+	std::function< bool ( const QFileInfo & file ) > isDesiredFile )
 {
 	// note down the currently selected item
 	QString lastText = comboBox->currentText();
 
-	unsetCurrentItem( comboBox );
-
-	updateModelFromDir( model, dir, recursively, includeEmptyItem, pathConvertor, isDesiredFile );
+	updateModelFromDir( model, snapshot, includeEmptyItem, isDesiredFile );
 
-	// restore the originally selected item, the selection will be reset if the item does not exist in the new content
-	// because findText returns -1 which is valid value for setCurrentIndex
+	// Restore the originally selected item, the selection will be reset if the item does not exist in the new content
+	// because findText returns -1 which is valid value for setCurrentIndex. When the item remained in the model,
+	// the combo-box kept it current and this does nothing.
 	setCurrentItemByIndex( comboBox, comboBox->findText( lastText ) );
 }
 
+/// Fills a combo-box with entries found in a directory. The directory is read in the calling thread.
+template< typename ListModel >
+void updateComboBoxFromDir(
+	ListModel & model, QComboBox * comboBox, const QString & dir, bool recursively, bool includeEmptyItem,
+	const PathConvertor & pathConvertor, std::function< bool ( const QFileInfo & file ) > isDesiredFile )
+{
+	updateComboBoxFromDir( model, comboBox, *takeDirSnapshot( dir, recursively, pathConvertor ), includeEmptyItem, isDesiredFile );
+}
+
 
 
 
@@ -0,0 +1,298 @@
+//======================================================================================================================
+// Project: DoomRunner
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: index of all entries of a zip file for random access by name
+//======================================================================================================================
+
+#include "ZipEntryIndex.hpp"
+
+#include "MappedFile.hpp"
+#include "FileStatCache.hpp"
+#include "CommonTypes.hpp"  // qsize_t
+
+#include <QtEndian>
+
+#include <mutex>
+#include <algorithm>  // min_element
+
+
+//======================================================================================================================
+// zip format
+//
+// https://pkware.cachefly.net/webdocs/casestudies/APPNOTE.TXT
+//
+// [local file header][file data] x entryCount
+// [central directory header] x entryCount
+// [zip64 end of central directory record]   (only in zip64)
+// [zip64 end of central directory locator]  (only in zip64)
+// [end of central directory record]
+//
+// All numbers are little-endian and the structures are not aligned, so they are read field by field.
+
+static constexpr uint32_t eocdSignature = 0x06054b50;
+static constexpr qint64 eocdSize = 22;
+static constexpr qint64 maxCommentSize = 0xFFFF;
+
+static constexpr uint32_t zip64LocatorSignature = 0x07064b50;
+static constexpr qint64 zip64LocatorSize = 20;
+
+static constexpr uint32_t zip64EocdSignature = 0x06064b50;
+static constexpr qint64 zip64EocdSize = 56;
+
+static constexpr uint32_t centralDirHeaderSignature = 0x02014b50;
+static constexpr qint64 centralDirHeaderSize = 46;
+
+static constexpr uint16_t zip64ExtraFieldID = 0x0001;
+static constexpr uint16_t utf8NameFlag = 1 << 11;
+
+template< typename Int >
+static Int readLE( const uchar * src )
+{
+	return qFromLittleEndian< Int >( src );
+}
+
+
+//======================================================================================================================
+// ZipEntryIndex
+
+ReadStatus ZipEntryIndex::open( const QString & filePath )
+{
+	_filePath = filePath;
+	_bytesBeforeZip = 0;
+	_entries.clear();
+	_entriesByName.clear();
+
+	fs::MappedFile file;  // only needed while the central directory is being read
+	ReadStatus openStatus = file.open( filePath );
+	if (openStatus != ReadStatus::Success)
+	{
+		logRuntimeError().noquote() << "cannot open \""<<filePath<<"\": "<<file.errorString();
+		return openStatus;
+	}
+
+	if (!readCentralDirectory( file.data(), file.size() ))
+	{
+		_entries.clear();
+		_entriesByName.clear();
+		return ReadStatus::InvalidFormat;
+	}
+
+	return ReadStatus::Success;
+}
+
+bool ZipEntryIndex::readCentralDirectory( const uchar * data, qint64 size )
+{
+	// find the end of central directory record, it's at the end of the file followed only by a variable-length comment
+
+	if (size < eocdSize)
+	{
+		logDebug() << _filePath << " is smaller than the end of central directory record";
+		return false;
+	}
+	qint64 eocdPos = -1;
+	const qint64 lowestPos = std::max( qint64(0), size - eocdSize - maxCommentSize );
+	for (qint64 pos = size - eocdSize; pos >= lowestPos; --pos)
+	{
+		// the comment length must match, otherwise it's just the signature bytes appearing inside the comment
+		if (readLE< uint32_t >( data + pos ) == eocdSignature && pos + eocdSize + readLE< uint16_t >( data + pos + 20 ) == size)
+		{
+			eocdPos = pos;
+			break;
+		}
+	}
+	if (eocdPos < 0)
+	{
+		logDebug() << _filePath << ": end of central directory not found, not a zip file";
+		return false;
+	}
+
+	const uchar * eocd = data + eocdPos;
+	uint64_t entryCount = readLE< uint16_t >( eocd + 10 );
+	uint64_t centralDirSize = readLE< uint32_t >( eocd + 12 );
+	uint64_t centralDirOffset = readLE< uint32_t >( eocd + 16 );
+	qint64 centralDirEnd = eocdPos;  // where the central directory actually ends in the file
+
+	// zip64 stores the real values in another record, the classic one contains only 0xFFFF or 0xFFFFFFFF
+	if (eocdPos >= zip64LocatorSize && readLE< uint32_t >( eocd - zip64LocatorSize ) == zip64LocatorSignature)
+	{
+		qint64 zip64EocdPos = qint64( readLE< uint64_t >( eocd - zip64LocatorSize + 8 ) );
+		// the recorded position doesn't include the data prepended before the zip, the record is right before the locator
+		qint64 expectedPos = eocdPos - zip64LocatorSize - zip64EocdSize;
+		if (expectedPos < 0 || readLE< uint32_t >( data + expectedPos ) != zip64EocdSignature)
+		{
+			expectedPos = zip64EocdPos;
+			if (expectedPos < 0 || expectedPos > size - zip64EocdSize || readLE< uint32_t >( data + expectedPos ) != zip64EocdSignature)
+			{
+				logRuntimeError() << _filePath << ": zip64 end of central directory record not found";
+				return false;
+			}
+		}
+		const uchar * zip64Eocd = data + expectedPos;
+		entryCount = readLE< uint64_t >( zip64Eocd + 32 );
+		centralDirSize = readLE< uint64_t >( zip64Eocd + 40 );
+		centralDirOffset = readLE< uint64_t >( zip64Eocd + 48 );
+		centralDirEnd = expectedPos;
+	}
+
+	if (centralDirSize > uint64_t( centralDirEnd ) || centralDirOffset > uint64_t( centralDirEnd ) - centralDirSize)
+	{
+		logRuntimeError() << _filePath << ": central directory points beyond the end of file";
+		return false;
+	}
+	// same as byte_before_the_zipfile in minizip
+	_bytesBeforeZip = centralDirEnd - qint64( centralDirSize ) - qint64( centralDirOffset );
+
+	// each entry takes at least the fixed part of the header, anything more is garbage
+	if (entryCount > centralDirSize / centralDirHeaderSize)
+	{
+		logRuntimeError() << _filePath << ": central directory is too small for "<<entryCount<<" entries";
+		return false;
+	}
+
+	// read all the central directory headers
+
+	_entries.reserve( size_t( entryCount ) );
+	_entriesByName.reserve( qsize_t( entryCount ) );
+
+	const qint64 centralDirPos = qint64( centralDirOffset ) + _bytesBeforeZip;
+	qint64 headerPos = centralDirPos;
+	for (uint64_t i = 0; i < entryCount; ++i)
+	{
+		if (centralDirEnd - headerPos < centralDirHeaderSize || readLE< uint32_t >( data + headerPos ) != centralDirHeaderSignature)
+		{
+			logRuntimeError() << _filePath << ": central directory entry "<<i<<" is corrupted";
+			return false;
+		}
+		const uchar * header = data + headerPos;
+
+		Entry entry;
+		entry.flags = readLE< uint16_t >( header + 8 );
+		entry.method = readLE< uint16_t >( header + 10 );
+		entry.crc32 = readLE< uint32_t >( header + 16 );
+		entry.compressedSize = readLE< uint32_t >( header + 20 );
+		entry.uncompressedSize = readLE< uint32_t >( header + 24 );
+		entry.localHeaderOffset = readLE< uint32_t >( header + 42 );
+		entry.centralDirOffset = uint64_t( headerPos - _bytesBeforeZip );
+
+		const qint64 nameLength = readLE< uint16_t >( header + 28 );
+		const qint64 extraLength = readLE< uint16_t >( header + 30 );
+		const qint64 commentLength = readLE< uint16_t >( header + 32 );
+		const qint64 headerEnd = headerPos + centralDirHeaderSize + nameLength + extraLength + commentLength;
+		if (headerEnd > centralDirEnd)
+		{
+			logRuntimeError() << _filePath << ": central directory entry "<<i<<" is corrupted";
+			return false;
+		}
+
+		const char * name = reinterpret_cast< const char * >( header + centralDirHeaderSize );
+		entry.name = (entry.flags & utf8NameFlag) ? QString::fromUtf8( name, int( nameLength ) ) : QString::fromLatin1( name, int( nameLength ) );
+
+		// the values that don't fit into 32 bits are in the zip64 extra field, in this order
+		const uchar * extra = header + centralDirHeaderSize + nameLength;
+		for (qint64 extraPos = 0; extraPos + 4 <= extraLength; )
+		{
+			uint16_t fieldID = readLE< uint16_t >( extra + extraPos );
+			qint64 fieldSize = readLE< uint16_t >( extra + extraPos + 2 );
+			const uchar * field = extra + extraPos + 4;
+			const uchar * fieldEnd = field + std::min( fieldSize, extraLength - extraPos - 4 );
+			if (fieldID == zip64ExtraFieldID)
+			{
+				for (uint64_t * value : { &entry.uncompressedSize, &entry.compressedSize, &entry.localHeaderOffset })
+				{
+					if (*value == 0xFFFFFFFF && fieldEnd - field >= 8)
+					{
+						*value = readLE< uint64_t >( field );
+						field += 8;
+					}
+				}
+				break;
+			}
+			extraPos += 4 + fieldSize;
+		}
+
+		// when the same name is there more than once, the first one is used, the same as unzLocateFile() does
+		QString key = entry.name.toLower();
+		if (!_entriesByName.contains( key ))
+		{
+			_entriesByName.insert( std::move(key), int( _entries.size() ) );
+		}
+		_entries.push_back( std::move(entry) );
+
+		headerPos = headerEnd;
+	}
+
+	return true;
+}
+
+int ZipEntryIndex::findEntry( const QString & entryName ) const
+{
+	return _entriesByName.value( entryName.toLower(), NotFound );
+}
+
+int ZipEntryIndex::findFirstOfEntries( const QStringList & entryNames ) const
+{
+	for (const QString & entryName : entryNames)
+	{
+		int entryIdx = findEntry( entryName );
+		if (entryIdx != NotFound)
+			return entryIdx;
+	}
+	return NotFound;
+}
+
+
+//======================================================================================================================
+// index cache
+
+// Big archives with tens of thousands of entries take megabytes of memory, so only a few recently used are kept.
+static constexpr int maxCachedIndexes = 16;
+
+struct CachedZipIndex
+{
+	std::shared_ptr< const ZipEntryIndex > index;
+	FileStamp fileStamp;
+	uint64_t lastUsed;
+};
+
+static std::mutex g_zipIndexCacheMtx;
+static QHash< QString, CachedZipIndex > g_zipIndexCache;
+static uint64_t g_zipIndexUseCounter = 0;
+
+UncertainZipEntryIndex getZipEntryIndex( const QString & zipFilePath )
+{
+	FileStamp fileStamp = g_fileStatCache.getFileStamp( zipFilePath );
+
+	{
+		std::unique_lock< std::mutex > lock( g_zipIndexCacheMtx );
+
+		auto cachedIter = g_zipIndexCache.find( zipFilePath );
+		if (cachedIter != g_zipIndexCache.end()
+		 && cachedIter->fileStamp.lastModified == fileStamp.lastModified && cachedIter->fileStamp.fileSize == fileStamp.fileSize)
+		{
+			cachedIter->lastUsed = ++g_zipIndexUseCounter;
+			return cachedIter->index;
+		}
+	}
+
+	// parse it without holding the lock, so that other threads can work with other files
+	auto index = std::make_shared< ZipEntryIndex >();
+	ReadStatus openStatus = index->open( zipFilePath );
+	if (openStatus != ReadStatus::Success)
+	{
+		return openStatus;
+	}
+
+	std::unique_lock< std::mutex > lock( g_zipIndexCacheMtx );
+
+	if (g_zipIndexCache.size() >= maxCachedIndexes && !g_zipIndexCache.contains( zipFilePath ))
+	{
+		auto leastRecentlyUsed = std::min_element( g_zipIndexCache.begin(), g_zipIndexCache.end(),
+			[]( const CachedZipIndex & a, const CachedZipIndex & b ) { return a.lastUsed < b.lastUsed; }
+		);
+		g_zipIndexCache.erase( leastRecentlyUsed );
+	}
+	g_zipIndexCache.insert( zipFilePath, { index, fileStamp, ++g_zipIndexUseCounter } );
+
+	return std::shared_ptr< const ZipEntryIndex >( std::move(index) );
+}
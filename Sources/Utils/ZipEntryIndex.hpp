@@ -0,0 +1,93 @@
+//======================================================================================================================
+// Project: DoomRunner
+//----------------------------------------------------------------------------------------------------------------------
+// Author:      Jan Broz (Youda008)
+// Description: index of all entries of a zip file for random access by name
+//======================================================================================================================
+
+#ifndef ZIP_ENTRY_INDEX_INCLUDED
+#define ZIP_ENTRY_INDEX_INCLUDED
+
+
+#include "Essential.hpp"
+
+#include "FileInfoCacheTypes.hpp"  // ReadStatus
+#include "LangUtils.hpp"           // ValueOrError
+#include "ErrorHandling.hpp"       // LoggingComponent
+
+#include <QString>
+#include <QStringList>
+#include <QHash>
+
+#include <vector>
+#include <memory>
+
+
+//======================================================================================================================
+/// Index of all entries of a zip file, built from a single pass over its central directory.
+/** The central directory is parsed directly from the memory-mapped file, the file is unmapped once the index is built,
+  * so that it's not kept locked. Looking up an entry by name is a single hash lookup instead of a linear scan
+  * of the central directory that unzLocateFile() does. */
+
+class ZipEntryIndex : protected LoggingComponent {
+
+ public:
+
+	struct Entry
+	{
+		QString name;               ///< path inside the archive with '/' as separator, directories end with '/'
+		uint16_t method;            ///< compression method, 0 = stored, 8 = deflated
+		uint16_t flags;
+		uint32_t crc32;
+		uint64_t compressedSize;
+		uint64_t uncompressedSize;
+		uint64_t localHeaderOffset;
+		uint64_t centralDirOffset;  ///< position of the central directory record, as expected by unzSetOffset64()
+	};
+
+	static constexpr int NotFound = -1;
+
+	ZipEntryIndex() : LoggingComponent( u"ZipEntryIndex" ) {}
+
+	/// Reads the central directory of the zip file and indexes all its entries.
+	/** Returns InvalidFormat when it's not a valid zip file. */
+	ReadStatus open( const QString & filePath );
+
+	const QString & filePath() const      { return _filePath; }
+
+	int entryCount() const                { return int( _entries.size() ); }
+	const Entry & entry( int idx ) const  { return _entries[ size_t( idx ) ]; }
+	auto begin() const                    { return _entries.begin(); }
+	auto end() const                      { return _entries.end(); }
+
+	/// Number of bytes preceding the zip data in the file, for example a self-extractor stub.
+	/** Must be added to the offsets stored in the entries to get the position within the file. */
+	qint64 bytesBeforeZip() const         { return _bytesBeforeZip; }
+
+	/// Returns index of an entry with this path inside the archive, or NotFound. The comparison is case-insensitive.
+	int findEntry( const QString & entryName ) const;
+
+	/// Returns index of the first of the entryNames that exists in the archive, or NotFound.
+	int findFirstOfEntries( const QStringList & entryNames ) const;
+
+ private:
+
+	bool readCentralDirectory( const uchar * data, qint64 size );
+
+	QString _filePath;
+	qint64 _bytesBeforeZip = 0;
+	std::vector< Entry > _entries;
+	QHash< QString, int > _entriesByName;  ///< keys are lower-case
+
+};
+
+
+using UncertainZipEntryIndex = ValueOrError< std::shared_ptr< const ZipEntryIndex >, ReadStatus, ReadStatus::Success >;
+
+/// Returns an index of the zip file, either the one built by a previous call or a new one.
+/** The indexes of a limited number of recently used files are kept for the whole session and rebuilt only
+  * when the file is modified. Can be called from any thread. */
+UncertainZipEntryIndex getZipEntryIndex( const QString & zipFilePath );
+
+
+#endif // ZIP_ENTRY_INDEX_INCLUDED
@@ -7,115 +7,288 @@
 
 #include "ZipReader.hpp"
 
-#include "LangUtils.hpp"        // autoClosable
+#include "CommonTypes.hpp"      // qsize_t
 #include "StringUtils.hpp"      // operator<<( QTextStream &, const QStringList & )
 #include "FileSystemUtils.hpp"  // isValidFile
-#include "ErrorHandling.hpp"
 
 #include <minizip/unzip.h>
 
+#include <algorithm>  // sort, min, max
+#include <climits>    // INT_MAX
+
 
 //======================================================================================================================
-// implementation
+// ZipEntryReader
 
-// logging helper
-class LoggingZipReader : protected LoggingComponent {
+ReadStatus ZipEntryReader::openZip( const QString & zipFilePath )
+{
+	close();
 
- public:
+	// we need a distinguishable error code when the file does not exist
+	if (!fs::isValidFile( zipFilePath ))
+	{
+		return ReadStatus::NotFound;
+	}
 
-	LoggingZipReader( QString filePath ) : LoggingComponent( u"ZipReader" ), _filePath( std::move(filePath) ) {}
+	// the names are resolved in the index, the file is not even opened when it has been indexed before
+	auto zipIndex = getZipEntryIndex( zipFilePath );
+	if (!zipIndex)
+	{
+		return zipIndex.error();
+	}
 
-	UncertainFileContent readOneOfFilesInsideZip( const QStringList & innerFileNames );
+	_zipFilePath = zipFilePath;
+	_index = std::move( zipIndex.value() );
+	return ReadStatus::Success;
+}
 
- private:
+ReadStatus ZipEntryReader::openEntry( const ZipEntryIndex::Entry & entry )
+{
+	closeEntry();
 
-	QString _filePath;
+	if (!_zipFile)
+	{
+		_zipFile = unzOpen64( _zipFilePath.toUtf8().constData() );
+		if (!_zipFile)
+		{
+			logRuntimeError() << "Cannot open "<<_zipFilePath;
+			return ReadStatus::CantOpen;
+		}
+	}
+
+	// jump directly to the entry
+	if (unzSetOffset64( _zipFile, entry.centralDirOffset ) != UNZ_OK)
+	{
+		logRuntimeError() << "Failed to seek to "<<entry.name<<" within "<<_zipFilePath;
+		return ReadStatus::FailedToRead;
+	}
+
+	// open the selected inner file for reading
+	if (unzOpenCurrentFile( _zipFile ) != UNZ_OK)
+	{
+		logRuntimeError() << "Failed to open file "<<entry.name<<" within "<<_zipFilePath;
+		return ReadStatus::CantOpen;
+	}
 
-};
+	_entry = entry;
+	_entryOpen = true;
+	_position = 0;
+	return ReadStatus::Success;
+}
 
-UncertainFileContent LoggingZipReader::readOneOfFilesInsideZip( const QStringList & innerFileNames )
+ReadStatus ZipEntryReader::open( const QString & zipFilePath, const QStringList & innerFileNames )
 {
-	// we need a distinguishable error code when the file does not exist
-	if (!fs::isValidFile( _filePath ))
+	ReadStatus zipStatus = openZip( zipFilePath );
+	if (zipStatus != ReadStatus::Success)
 	{
-		return ReadStatus::NotFound;
+		return zipStatus;
 	}
 
-	// open the zip file
-	unzFile zipFile = unzOpen( _filePath.toUtf8().constData() );
-	if (!zipFile)
+	int entryIdx = _index->findFirstOfEntries( innerFileNames );
+	if (entryIdx == ZipEntryIndex::NotFound)
 	{
-		logRuntimeError() << "Cannot open "<<_filePath;
-		return ReadStatus::CantOpen;
+		logDebug() << "Couldn't find "<<innerFileNames<<" within "<<_zipFilePath;
+		return ReadStatus::InfoNotPresent;
+	}
+
+	return openEntry( _index->entry( entryIdx ) );
+}
+
+void ZipEntryReader::closeEntry()
+{
+	if (_entryOpen)
+	{
+		unzCloseCurrentFile( _zipFile );
+		_entryOpen = false;
+	}
+}
+
+void ZipEntryReader::close()
+{
+	closeEntry();
+	if (_zipFile)
+	{
+		unzClose( _zipFile );
+		_zipFile = nullptr;
+	}
+	_index.reset();
+}
+
+qint64 ZipEntryReader::read( char * buffer, qint64 maxSize )
+{
+	if (!_entryOpen)
+	{
+		logLogicError() << "No entry of "<<_zipFilePath<<" is open";
+		return -1;
 	}
-	auto zipFileGuard = autoClosable( zipFile, unzClose );
 
-	// find one of innerFileNames
-	QString foundInnerFileName;
-	for (const QString & innerFileName : innerFileNames)
+	qint64 totalRead = 0;
+	while (totalRead < maxSize)  // unzReadCurrentFile() takes only 32-bit sizes
 	{
-		if (unzLocateFile( zipFile, innerFileName.toUtf8().constData(), 0 ) == UNZ_OK)
+		unsigned toRead = unsigned( std::min( maxSize - totalRead, qint64( INT_MAX ) ) );
+		int bytesRead = unzReadCurrentFile( _zipFile, buffer + totalRead, toRead );
+		if (bytesRead < 0)
+		{
+			logRuntimeError() << "Failed to read file "<<_entry.name<<" within "<<_zipFilePath;
+			return -1;
+		}
+		if (bytesRead == 0)  // end of the entry
 		{
-			foundInnerFileName = innerFileName;
 			break;
 		}
-	}
-	if (foundInnerFileName.isNull())
-	{
-		logDebug() << "Couldn't find "<<innerFileNames<<" within "<<_filePath;
-		return ReadStatus::InfoNotPresent;
+		totalRead += bytesRead;
 	}
 
-	// get metadata about the selected inner file
-	unz_file_info fileInfo;
-	char unused [256];
-	if (unzGetCurrentFileInfo( zipFile, &fileInfo, unused, sizeof(unused), nullptr, 0, nullptr, 0 ) != UNZ_OK)
+	_position += totalRead;
+	return totalRead;
+}
+
+bool ZipEntryReader::readExactly( char * buffer, qint64 size )
+{
+	qint64 bytesRead = read( buffer, size );
+	if (bytesRead >= 0 && bytesRead < size)
 	{
-		logRuntimeError() << "Failed to get file info of "<<foundInnerFileName<<" within "<<_filePath;
-		return ReadStatus::CantOpen;
+		logRuntimeError() << "File "<<_entry.name<<" within "<<_zipFilePath<<" ended unexpectedly"
+		                  << " (wanted "<<size<<" bytes at position "<<(_position - bytesRead)<<")";
 	}
+	return bytesRead == size;
+}
+
+bool ZipEntryReader::skip( qint64 size )
+{
+	if (_chunk.isEmpty())
+		_chunk.resize( chunkSize );
 
-	// safety check - don't try to decompress a file that is nonsensically large
-	if (fileInfo.uncompressed_size > 10*1024*1024)
+	while (size > 0)
 	{
-		logRuntimeError() << "Refusing to read file "<<foundInnerFileName<<" within "<<_filePath
-		                  << ", because it is too large ("<<fileInfo.uncompressed_size<<" bytes)";
-		return ReadStatus::FailedToRead;
+		qint64 toRead = std::min( size, qint64( _chunk.size() ) );
+		if (!readExactly( _chunk.data(), toRead ))
+			return false;
+		size -= toRead;
 	}
-	int uncompressedSize = static_cast< int >( fileInfo.uncompressed_size );
+	return true;
+}
 
-	// open the selected inner file for reading
-	if (unzOpenCurrentFile( zipFile ) != UNZ_OK)
+UncertainFileContent ZipEntryReader::readAll()
+{
+	qint64 expectedSize = entrySize() - _position;
+
+	// safety check - don't try to decompress a file that is nonsensically large into memory
+	if (expectedSize > maxExtractedFileSize)
 	{
-		logRuntimeError() << "Failed to open file "<<foundInnerFileName<<" within "<<_filePath;
-		return ReadStatus::CantOpen;
+		logRuntimeError() << "Refusing to read file "<<_entry.name<<" within "<<_zipFilePath
+		                  << " into memory, because it is too large ("<<expectedSize<<" bytes)";
+		return ReadStatus::FailedToRead;
 	}
-	auto currentFileGuard = atScopeEndDo( [ &zipFile ]() { unzCloseCurrentFile( zipFile ); } );
 
-	// decompress and read the inner file
+	// if the zip directory is damaged, the actual content might be shorter than declared
 	QByteArray buffer;
-	buffer.resize( uncompressedSize );
-	int bytesRead = unzReadCurrentFile( zipFile, buffer.data(), buffer.size() );
+	buffer.resize( qsize_t( std::max( expectedSize, qint64(0) ) ) );
+	qint64 bytesRead = read( buffer.data(), buffer.size() );
 	if (bytesRead < 0)
 	{
-		logRuntimeError() << "Failed to read file "<<foundInnerFileName<<" within "<<_filePath;
 		return ReadStatus::FailedToRead;
 	}
-	else if (bytesRead < uncompressedSize)
+	else if (bytesRead < buffer.size())
 	{
-		logRuntimeError() << "Couldn't read the whole file "<<foundInnerFileName<<" within "<<_filePath
+		logRuntimeError() << "Couldn't read the whole file "<<_entry.name<<" within "<<_zipFilePath
 		                  << " (read only "<<bytesRead<<" bytes)";
-		buffer.resize( bytesRead );
+		buffer.resize( qsize_t( bytesRead ) );
 	}
 	return buffer;
 }
 
 
 //======================================================================================================================
-// public API
+// convenience functions
 
 UncertainFileContent readOneOfFilesInsideZip( const QString & zipFilePath, const QStringList & innerFileNames )
 {
-	LoggingZipReader zipReader( zipFilePath );
-	return zipReader.readOneOfFilesInsideZip( innerFileNames );
+	ZipEntryReader zipReader;
+
+	ReadStatus openStatus = zipReader.open( zipFilePath, innerFileNames );
+	if (openStatus != ReadStatus::Success)
+	{
+		return openStatus;
+	}
+
+	return zipReader.readAll();
+}
+
+UncertainZipContent readFilesInsideZip( const QString & zipFilePath, const ZipExtractionRequest & request )
+{
+	ZipEntryReader zipReader;
+
+	ReadStatus openStatus = zipReader.openZip( zipFilePath );
+	if (openStatus != ReadStatus::Success)
+	{
+		return openStatus;
+	}
+
+	return readFilesInsideZip( zipReader, request );
+}
+
+UncertainZipContent readFilesInsideZip( ZipEntryReader & zipReader, const ZipExtractionRequest & request )
+{
+	const ZipEntryIndex & index = zipReader.index();
+
+	ZipExtractionResult result;
+
+	struct FoundFile
+	{
+		int resultIdx;
+		const ZipEntryIndex::Entry * entry;
+	};
+	QList< FoundFile > foundFiles;
+
+	result.files.reserve( request.files.size() );
+	for (const QStringList & fileNames : request.files)
+	{
+		int entryIdx = index.findFirstOfEntries( fileNames );
+		if (entryIdx != ZipEntryIndex::NotFound)
+			foundFiles.append({ int( result.files.size() ), &index.entry( entryIdx ) });
+		result.files.append( UncertainFileContent( ReadStatus::InfoNotPresent ) );
+	}
+
+	// all the listings are collected in a single walk through the entries
+	if (!request.listedDirs.isEmpty())
+	{
+		for (const ZipEntryIndex::Entry & entry : index)
+		{
+			for (const QString & dir : request.listedDirs)
+			{
+				if (entry.name.size() > dir.size()
+				 && entry.name.startsWith( dir, Qt::CaseInsensitive )
+				 && entry.name.indexOf( '/', dir.size() ) < 0)  // not in a subdirectory
+				{
+					bool suffixMatches = request.listedSuffixes.isEmpty();
+					for (const QString & suffix : request.listedSuffixes)
+						suffixMatches |= entry.name.endsWith( suffix, Qt::CaseInsensitive );
+					if (suffixMatches)
+						result.listedEntries.append( entry.name );
+					break;
+				}
+			}
+		}
+	}
+
+	// decompress in the order of the data within the file, so that it's read sequentially
+	std::sort( foundFiles.begin(), foundFiles.end(), []( const FoundFile & f1, const FoundFile & f2 )
+	{
+		return f1.entry->localHeaderOffset < f2.entry->localHeaderOffset;
+	});
+
+	for (const FoundFile & foundFile : foundFiles)
+	{
+		UncertainFileContent & fileContent = result.files[ foundFile.resultIdx ];
+
+		ReadStatus entryStatus = zipReader.openEntry( *foundFile.entry );
+		if (entryStatus == ReadStatus::CantOpen && !zipReader.isZipOpen())
+		{
+			return entryStatus;  // the zip file itself can't be opened, no point trying the other entries
+		}
+		fileContent = entryStatus == ReadStatus::Success ? zipReader.readAll() : UncertainFileContent( entryStatus );
+	}
+
+	return std::move( result );
 }
@@ -13,14 +13,118 @@
 
 #include "FileInfoCacheTypes.hpp"  // ReadStatus
 #include "LangUtils.hpp"           // ValueOrError
+#include "ZipEntryIndex.hpp"
+#include "ErrorHandling.hpp"       // LoggingComponent
 
 #include <QString>
 #include <QStringList>
 #include <QByteArray>
+#include <QList>
+
+#include <memory>
 
 
 using UncertainFileContent = ValueOrError<QByteArray, ReadStatus, ReadStatus::Success>;
 
+/// Everything that should be extracted from a zip file in one go.
+struct ZipExtractionRequest
+{
+	QList< QStringList > files;   ///< for each wanted file, alternative names in the order of preference
+	QStringList listedDirs;       ///< directories whose direct entries should be listed, each ending with '/'
+	QStringList listedSuffixes;   ///< only entries with one of these suffixes are listed, all entries when empty
+};
+
+/// Results of a ZipExtractionRequest.
+struct ZipExtractionResult
+{
+	QList< UncertainFileContent > files;  ///< one for each wanted file, InfoNotPresent when none of its names is found
+	QStringList listedEntries;            ///< full paths of the entries within the listed directories
+};
+
+using UncertainZipContent = ValueOrError<ZipExtractionResult, ReadStatus, ReadStatus::Success>;
+
+/// Files bigger than this are not extracted into memory as a whole, they can only be read sequentially through ZipEntryReader.
+inline constexpr qint64 maxExtractedFileSize = 256 * 1024 * 1024;
+
+
+//======================================================================================================================
+/// Sequential reader of files inside a zip file, decompresses only as much as is requested.
+/** The memory usage is constant regardless of the size of the file, so even very large inner files
+  * (for example WADs embedded in a pk3) can be parsed without extracting them whole.
+  * The zip file is opened lazily, when the first entry is opened. */
+
+class ZipEntryReader : protected LoggingComponent {
+
+ public:
+
+	/// Size of the chunks in which the data are decompressed when they are skipped.
+	static constexpr qint64 chunkSize = 64 * 1024;
+
+	ZipEntryReader() : LoggingComponent( u"ZipEntryReader" ) {}
+	~ZipEntryReader()  { close(); }
+
+	ZipEntryReader( const ZipEntryReader & other ) = delete;
+	ZipEntryReader & operator=( const ZipEntryReader & other ) = delete;
+
+	/// Prepares the zip file for reading, the returned status will be NotFound when the zip file doesn't exist.
+	ReadStatus openZip( const QString & zipFilePath );
+
+	/// Index of the entries of the opened zip file, valid after openZip() succeeds.
+	const ZipEntryIndex & index() const  { return *_index; }
+
+	/// Opens an entry of the opened zip file for reading, the previously opened entry is closed.
+	ReadStatus openEntry( const ZipEntryIndex::Entry & entry );
+
+	/// Opens the current entry again and starts reading it from the beginning.
+	/** Compressed data can't be seeked backwards, so this is the only way to get to an earlier position. */
+	ReadStatus reopenEntry()  { return openEntry( _entry ); }
+
+	/// Combines openZip() and openEntry() for the first of innerFileNames that is found within the zip file.
+	/** The returned status will be NotFound when the zip file is not found,
+	  * but InfoNotPresent when none of the innerFileNames is found. */
+	ReadStatus open( const QString & zipFilePath, const QStringList & innerFileNames );
+
+	void closeEntry();
+	void close();
+
+	bool isZipOpen() const  { return _zipFile != nullptr; }
+
+	const QString & zipFilePath() const  { return _zipFilePath; }
+	const QString & entryName() const  { return _entry.name; }
+	/// Size declared in the zip directory, the actual content may be shorter if the file is damaged.
+	qint64 entrySize() const  { return qint64( _entry.uncompressedSize ); }
+	/// Number of bytes of the current entry that have already been read or skipped.
+	qint64 position() const  { return _position; }
+
+	/// Decompresses up to maxSize bytes into the buffer.
+	/** Returns the number of bytes read, 0 at the end of the entry and -1 on error. */
+	qint64 read( char * buffer, qint64 maxSize );
+
+	/// Decompresses exactly size bytes into the buffer, returns false when the entry ends earlier or on error.
+	bool readExactly( char * buffer, qint64 size );
+
+	/// Decompresses and discards the next size bytes, returns false when the entry ends earlier or on error.
+	/** Compressed data can't be seeked, so this is the only way to get to a later position. */
+	bool skip( qint64 size );
+
+	/// Decompresses the rest of the entry into memory. Fails for entries bigger than maxExtractedFileSize.
+	UncertainFileContent readAll();
+
+ private:
+
+	QString _zipFilePath;
+	std::shared_ptr< const ZipEntryIndex > _index;
+	void * _zipFile = nullptr;  ///< unzFile
+	ZipEntryIndex::Entry _entry = {};
+	bool _entryOpen = false;
+	qint64 _position = 0;
+	QByteArray _chunk;  ///< buffer for skipping, allocated on first use
+
+};
+
+//======================================================================================================================
+// convenience functions
+
 /// Extracts the content of the first of innerFileNames that is found within the zip file.
 /** BEWARE that this operation may be very time consuming, depending on the size of the file and level of compression.
   * Doing this asynchronously is adviced.
@@ -28,5 +132,15 @@ using UncertainFileContent = ValueOrError<QByteArray, ReadStatus, ReadStatus::Su
   * but InfoNotPresent when none of the innerFileNames is found. */
 UncertainFileContent readOneOfFilesInsideZip( const QString & zipFilePath, const QStringList & innerFileNames );
 
+/// Extracts all the wanted files and lists the wanted directories while opening the zip file only once.
+/** The names are resolved using the index of the central directory and the found files are decompressed
+  * in the order they are stored in the zip file, so the file is read sequentially.
+  * The returned status will be NotFound when the zip file is not found, a file that is not found
+  * or fails to decompress has its own status in the result. */
+UncertainZipContent readFilesInsideZip( const QString & zipFilePath, const ZipExtractionRequest & request );
+
+/// Same as above, but uses a reader with already opened zip file, so that it can be used for further reading.
+UncertainZipContent readFilesInsideZip( ZipEntryReader & zipReader, const ZipExtractionRequest & request );
+
 
 #endif // ZIP_READER_INCLUDED